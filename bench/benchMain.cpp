@@ -0,0 +1,18 @@
+#include "bench_framework.hpp"
+
+#include <cstdio>
+#include <string_view>
+
+/*runs every benchmark, or only those whose name contains argv[1]*/
+int main(int argc, char** argv) {
+  const std::string_view filter = argc > 1 ? argv[1] : "";
+
+  for (auto const& [name, benchmark] : dlib_bench::registry()) {
+    if (name.find(filter) == std::string_view::npos) {
+      continue;
+    }
+    std::printf("== %.*s\n", static_cast<int>(name.size()), name.data());
+    benchmark();
+  }
+  return 0;
+}
@@ -0,0 +1,84 @@
+#include "bench_framework.hpp"
+
+#include <dlib/cache.hpp>
+
+namespace {
+  constexpr int key_space = 10000;
+  constexpr size_t ops_per_thread = 200000;
+
+  /*95% shallow_read hits, 5% set*/
+  template<typename Cache>
+  void read_heavy(std::string_view variant) {
+    for (size_t threads : dlib_bench::thread_counts) {
+      Cache cache;
+      for (int i = 0; i < key_space; ++i) {
+        cache.set(i, i);
+      }
+      std::vector<dlib_bench::Xorshift> rngs;
+      for (size_t t = 0; t < threads; ++t) {
+        rngs.emplace_back(t);
+      }
+
+      const double ops = dlib_bench::run_threads(threads, ops_per_thread, [&](size_t t, size_t) {
+        const uint64_t r = rngs[t]();
+        const int key = static_cast<int>(r % key_space);
+        if ((r >> 32) % 100 < 5) {
+          cache.set(key, key);
+        } else {
+          dlib_bench::do_not_optimize(cache.shallow_read(key));
+        }
+      });
+
+      dlib_bench::report("cache_read_heavy", variant, threads, ops);
+    }
+  }
+
+  /*90% shallow_read, 10% set over 4 times as many keys as fit, so sets keep adding keys and evicting others*/
+  template<typename Cache>
+  void churn(std::string_view variant) {
+    for (size_t threads : dlib_bench::thread_counts) {
+      Cache cache{ key_space };
+      for (int i = 0; i < key_space; ++i) {
+        cache.set(i, i);
+      }
+      std::vector<dlib_bench::Xorshift> rngs;
+      for (size_t t = 0; t < threads; ++t) {
+        rngs.emplace_back(t);
+      }
+
+      const double ops = dlib_bench::run_threads(threads, ops_per_thread, [&](size_t t, size_t) {
+        const uint64_t r = rngs[t]();
+        const int key = static_cast<int>(r % (4 * key_space));
+        if ((r >> 32) % 100 < 10) {
+          cache.set(key, key);
+        } else {
+          dlib_bench::do_not_optimize(cache.shallow_read(key));
+        }
+      });
+
+      dlib_bench::report("cache_churn", variant, threads, ops);
+    }
+  }
+}
+
+DLIB_BENCHMARK(cache_sharding) {
+  read_heavy<dlib::Cache<int, int>>("single lock");
+  read_heavy<dlib::Cache<int, int, dlib::Shards_is<16>>>("Shards_is<16>");
+  read_heavy<dlib::Cache<int, int, dlib::Shards_is<64>>>("Shards_is<64>");
+}
+
+DLIB_BENCHMARK(cache_snapshot_reads) {
+  read_heavy<dlib::Cache<int, int, dlib::Shards_is<64>>>("Locked_reads");
+  read_heavy<dlib::Cache<int, int, dlib::Shards_is<64>, dlib::Reads_is<dlib::Snapshot_reads>>>("Snapshot_reads");
+}
+
+DLIB_BENCHMARK(cache_snapshot_reads_churn) {
+  churn<dlib::Cache<int, int, dlib::Shards_is<64>>>("Locked_reads");
+  churn<dlib::Cache<int, int, dlib::Shards_is<64>, dlib::Reads_is<dlib::Snapshot_reads>>>("Snapshot_reads");
+}
+
+DLIB_BENCHMARK(cache_shared_reads) {
+  read_heavy<dlib::Cache<int, int, dlib::Eviction_is<dlib::Lru_eviction>>>("Lru, exclusive");
+  read_heavy<dlib::Cache<int, int, dlib::Eviction_is<dlib::Clock_eviction>>>("Clock, std::shared_mutex");
+  read_heavy<dlib::Cache<int, int, dlib::Eviction_is<dlib::Clock_eviction>, dlib::Concurrency_is<dlib::Spin_concurrency>>>("Clock, sharded readers");
+}
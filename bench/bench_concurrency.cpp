@@ -0,0 +1,47 @@
+#include "bench_framework.hpp"
+
+#include <dlib/cache.hpp>
+#include <dlib/pool.hpp>
+
+namespace {
+  constexpr size_t ops_per_thread = 500000;
+  constexpr int key_space = 64;
+
+  /*every thread on the one pool lock*/
+  template<typename Concurrency>
+  void pool_contention(std::string_view variant) {
+    for (size_t threads : dlib_bench::thread_counts) {
+      dlib::Pool<int, dlib::Concurrency_is<Concurrency>> pool;
+      const double ops = dlib_bench::run_threads(threads, ops_per_thread, [&](size_t, size_t i) {
+        auto got = pool.get([]() { return 0; });
+        *got.value() += static_cast<int>(i);
+        dlib_bench::do_not_optimize(*got.value());
+      });
+
+      dlib_bench::report("pool_contention", variant, threads, ops);
+    }
+  }
+
+  /*an unsharded cache over a few keys, so every read fights for the same lock*/
+  template<typename Concurrency>
+  void cache_contention(std::string_view variant) {
+    for (size_t threads : dlib_bench::thread_counts) {
+      dlib::Cache<int, int, dlib::Concurrency_is<Concurrency>> cache;
+      for (int i = 0; i < key_space; ++i) {
+        cache.set(i, i);
+      }
+      const double ops = dlib_bench::run_threads(threads, ops_per_thread, [&](size_t, size_t i) {
+        dlib_bench::do_not_optimize(cache.shallow_read(static_cast<int>(i % key_space)));
+      });
+
+      dlib_bench::report("cache_contention", variant, threads, ops);
+    }
+  }
+}
+
+DLIB_BENCHMARK(mutex_contention) {
+  pool_contention<dlib::Std_concurrency>("Std_concurrency");
+  pool_contention<dlib::Spin_concurrency>("Spin_concurrency");
+  cache_contention<dlib::Std_concurrency>("Std_concurrency");
+  cache_contention<dlib::Spin_concurrency>("Spin_concurrency");
+}
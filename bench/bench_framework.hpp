@@ -0,0 +1,99 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <atomic>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace dlib_bench {
+  using Benchmark = void(*)();
+
+  inline std::vector<std::pair<std::string_view, Benchmark>>& registry() noexcept {
+    static std::vector<std::pair<std::string_view, Benchmark>> benchmarks;
+    return benchmarks;
+  }
+
+  struct Registration {
+    Registration(std::string_view name, Benchmark benchmark) noexcept {
+      registry().emplace_back(name, benchmark);
+    }
+  };
+
+  /*keeps the optimizer from throwing away work we're timing*/
+  template<typename T>
+  void do_not_optimize(T const& value) noexcept {
+    static std::atomic<const void*> sink;
+    sink.store(&value, std::memory_order_relaxed);
+  }
+
+  /*runs functor(thread_index, op_index) ops_per_thread times on each of threads threads, returns total ops/sec*/
+  template<typename Functor>
+  double run_threads(size_t threads, size_t ops_per_thread, Functor&& functor) {
+    std::atomic<size_t> ready{ 0 };
+    std::atomic<bool> go{ false };
+    std::vector<std::thread> running;
+    running.reserve(threads);
+
+    for (size_t t = 0; t < threads; ++t) {
+      running.emplace_back([&, t]() {
+        ++ready;
+        while (!go.load(std::memory_order_acquire)) {
+          std::this_thread::yield();
+        }
+        for (size_t i = 0; i < ops_per_thread; ++i) {
+          functor(t, i);
+        }
+      });
+    }
+
+    while (ready.load() != threads) {
+      std::this_thread::yield();
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& thread : running) {
+      thread.join();
+    }
+    const std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+
+    return static_cast<double>(threads * ops_per_thread) / took.count();
+  }
+
+  inline void report(std::string_view benchmark, std::string_view variant, size_t threads, double ops_per_sec) noexcept {
+    std::printf("%-24.*s %-28.*s threads=%-3zu %14.0f ops/s\n",
+      static_cast<int>(benchmark.size()), benchmark.data(),
+      static_cast<int>(variant.size()), variant.data(),
+      threads,
+      ops_per_sec);
+  }
+
+  constexpr size_t thread_counts[] = { 1, 2, 4, 8 };
+
+  /*cheap per thread random numbers, so the generator isn't what we end up measuring*/
+  class Xorshift {
+  public:
+    explicit Xorshift(uint64_t seed) noexcept :
+      state_{ seed * 0x9E3779B97F4A7C15ULL + 1 } {
+
+    }
+
+    uint64_t operator()() noexcept {
+      state_ ^= state_ << 13;
+      state_ ^= state_ >> 7;
+      state_ ^= state_ << 17;
+      return state_;
+    }
+  private:
+    uint64_t state_;
+  };
+}
+
+#define DLIB_BENCHMARK(name) \
+  static void name(); \
+  static const ::dlib_bench::Registration name##_registration{ #name, &name }; \
+  static void name()
@@ -0,0 +1,127 @@
+#include "bench_framework.hpp"
+
+#include <dlib/cache.hpp>
+#include <dlib/numa.hpp>
+#include <dlib/pool.hpp>
+
+namespace {
+  constexpr size_t ops_per_thread = 200000;
+  constexpr size_t buffer_size = 4096;
+  constexpr int key_space = 1000;
+
+  /*a buffer that remembers which node first touched it*/
+  struct Buffer {
+    Buffer() :
+      node{ dlib::current_numa_node() },
+      bytes(buffer_size, 0) {
+
+    }
+    size_t node;
+    std::vector<char> bytes;
+  };
+
+  /*how many of the objects we used came from another node*/
+  struct Remote_count {
+    std::atomic<uint64_t> remote{ 0 };
+    std::atomic<uint64_t> total{ 0 };
+
+    void used(size_t from) noexcept {
+      if (from != dlib::current_numa_node()) {
+        remote.fetch_add(1, std::memory_order_relaxed);
+      }
+      total.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void report(std::string_view benchmark, std::string_view variant, size_t threads) const noexcept {
+      const double share = total == 0 ? 0.0 : 100.0 * static_cast<double>(remote.load()) / static_cast<double>(total.load());
+      std::printf("%-24.*s %-28.*s threads=%-3zu %13.1f%% remote\n",
+        static_cast<int>(benchmark.size()), benchmark.data(),
+        static_cast<int>(variant.size()), variant.data(),
+        threads,
+        share);
+    }
+  };
+
+  /*a source with every key, each read makes a fresh buffer on the reader's node*/
+  struct Everything {
+    bool contains(int) const noexcept {
+      return true;
+    }
+  };
+
+  struct Make_buffer {
+    std::optional<std::shared_ptr<const Buffer>> operator()(Everything*, int) const noexcept {
+      return std::make_shared<const Buffer>();
+    }
+  };
+
+  /*threads spread over the nodes, each stays on its own*/
+  void pin(size_t thread) noexcept {
+    thread_local bool pinned = false;
+    if (!pinned) {
+      dlib::pin_to_numa_node(thread % dlib::numa_node_count());
+      pinned = true;
+    }
+  }
+
+  /*get a buffer, write all of it, give it back*/
+  template<typename Pool>
+  void pool_churn(std::string_view variant) {
+    for (size_t threads : dlib_bench::thread_counts) {
+      Pool pool;
+      Remote_count remote;
+      const double ops = dlib_bench::run_threads(threads, ops_per_thread, [&](size_t t, size_t i) {
+        pin(t);
+        auto got = pool.get([]() { return Buffer{}; });
+        Buffer& buffer = *got.value();
+        remote.used(buffer.node);
+        for (size_t at = 0; at < buffer_size; at += 64) {
+          buffer.bytes[at] = static_cast<char>(i);
+        }
+        dlib_bench::do_not_optimize(buffer.bytes.data());
+      });
+
+      dlib_bench::report("numa_pool_churn", variant, threads, ops);
+      remote.report("numa_pool_churn", variant, threads);
+    }
+  }
+
+  /*deep_read a hot set of keys and read all of every line*/
+  template<typename Cache>
+  void cache_reads(std::string_view variant) {
+    for (size_t threads : dlib_bench::thread_counts) {
+      Cache cache;
+      cache.add_source(Everything{}, dlib::finder_get(Make_buffer{}));
+      std::vector<dlib_bench::Xorshift> rngs;
+      for (size_t t = 0; t < threads; ++t) {
+        rngs.emplace_back(t);
+      }
+      Remote_count remote;
+      const double ops = dlib_bench::run_threads(threads, ops_per_thread, [&](size_t t, size_t) {
+        pin(t);
+        const int key = static_cast<int>(rngs[t]() % key_space);
+        auto line = cache.deep_read(key);
+        if (!line) {
+          return;
+        }
+        remote.used(line.value()->node);
+        uint64_t sum = 0;
+        for (size_t at = 0; at < buffer_size; at += 64) {
+          sum += static_cast<uint64_t>(line.value()->bytes[at]);
+        }
+        dlib_bench::do_not_optimize(sum);
+      });
+
+      dlib_bench::report("numa_cache_reads", variant, threads, ops);
+      remote.report("numa_cache_reads", variant, threads);
+    }
+  }
+}
+
+DLIB_BENCHMARK(numa_placement) {
+  std::printf("numa nodes: %zu\n", dlib::numa_node_count());
+  pool_churn<dlib::Pool<Buffer>>("Pool");
+  pool_churn<dlib::Numa_pool<Buffer>>("Numa_pool");
+  cache_reads<dlib::Cache<int, Buffer, dlib::Shards_is<16>>>("Cache");
+  cache_reads<dlib::Numa_cache<int, Buffer, dlib::Shards_is<16>>>("Numa_cache");
+}
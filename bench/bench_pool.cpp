@@ -0,0 +1,28 @@
+#include "bench_framework.hpp"
+
+#include <dlib/pool.hpp>
+
+namespace {
+  constexpr size_t ops_per_thread = 1000000;
+  constexpr size_t buffer_size = 256;
+
+  /*get a buffer, touch it, give it back*/
+  template<typename Pool>
+  void churn(std::string_view variant) {
+    for (size_t threads : dlib_bench::thread_counts) {
+      Pool pool;
+      const double ops = dlib_bench::run_threads(threads, ops_per_thread, [&](size_t, size_t i) {
+        auto got = pool.get([]() { return std::vector<char>(buffer_size); });
+        (*got.value())[i % buffer_size] = static_cast<char>(i);
+        dlib_bench::do_not_optimize(got.value()->data());
+      });
+
+      dlib_bench::report("pool_churn", variant, threads, ops);
+    }
+  }
+}
+
+DLIB_BENCHMARK(pool_magazines) {
+  churn<dlib::Pool<std::vector<char>>>("Pool");
+  churn<dlib::Magazine_pool<std::vector<char>>>("Magazine_pool");
+}
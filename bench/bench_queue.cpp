@@ -0,0 +1,103 @@
+#include "bench_framework.hpp"
+
+#include <dlib/queue.hpp>
+
+namespace {
+  constexpr size_t ops_per_thread = 500000;
+  constexpr size_t round_trips = 100000;
+  constexpr size_t capacity = 1024;
+
+  template<typename Queue>
+  void push_all(Queue& queue, dlib::Array_view<size_t> values) noexcept {
+    size_t pushed = 0;
+    while (pushed < values.size()) {
+      const size_t went = queue.push_n(dlib::Array_view<size_t>{ values.data() + pushed, values.size() - pushed });
+      if (went == 0) {
+        std::this_thread::yield();
+      }
+      pushed += went;
+    }
+  }
+
+  template<typename Queue>
+  void pop_all(Queue& queue, dlib::Array_view<size_t> out) noexcept {
+    size_t popped = 0;
+    while (popped < out.size()) {
+      const size_t got = queue.pop_n(dlib::Array_view<size_t>{ out.data() + popped, out.size() - popped });
+      if (got == 0) {
+        std::this_thread::yield();
+      }
+      popped += got;
+    }
+  }
+
+  /*
+  pairs producers and consumers, so the first half of the threads push and
+  the second half pop, batch values per op. Reports values moved per second.
+  */
+  template<typename Queue>
+  void throughput(std::string_view variant, size_t pairs, size_t batch) {
+    Queue queue{ capacity };
+    const size_t ops = ops_per_thread / batch;
+    const double rate = dlib_bench::run_threads(pairs * 2, ops, [&](size_t t, size_t i) {
+      thread_local std::vector<size_t> values;
+      values.resize(batch);
+      if (t < pairs) {
+        for (size_t& value : values) {
+          value = i;
+        }
+        push_all(queue, values);
+      } else {
+        pop_all(queue, values);
+        dlib_bench::do_not_optimize(values[0]);
+      }
+    });
+    //half the threads pop what the other half pushed
+    dlib_bench::report("queue_throughput", variant, pairs, rate / 2 * static_cast<double>(batch));
+  }
+
+  /*a value bounced between two threads over a queue each way, nanoseconds per round trip*/
+  template<typename Queue>
+  void latency(std::string_view variant) {
+    Queue there{ capacity };
+    Queue back{ capacity };
+    std::thread echo{ [&]() {
+      size_t value = 0;
+      for (size_t i = 0; i < round_trips; ++i) {
+        pop_all(there, dlib::Array_view<size_t>{ &value, 1 });
+        push_all(back, dlib::Array_view<size_t>{ &value, 1 });
+      }
+    } };
+
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < round_trips; ++i) {
+      size_t value = i;
+      push_all(there, dlib::Array_view<size_t>{ &value, 1 });
+      pop_all(back, dlib::Array_view<size_t>{ &value, 1 });
+    }
+    const std::chrono::duration<double, std::nano> took = std::chrono::steady_clock::now() - start;
+    echo.join();
+
+    std::printf("%-24s %-28.*s threads=%-3d %14.0f ns/round trip\n",
+      "queue_latency",
+      static_cast<int>(variant.size()), variant.data(),
+      2,
+      took.count() / static_cast<double>(round_trips));
+  }
+}
+
+DLIB_BENCHMARK(queue_throughput) {
+  for (size_t pairs : dlib_bench::thread_counts) {
+    throughput<dlib::Mpmc_queue<size_t>>("Mpmc_queue", pairs, 1);
+  }
+  for (size_t pairs : dlib_bench::thread_counts) {
+    throughput<dlib::Mpmc_queue<size_t>>("Mpmc_queue, push_n/pop_n 32", pairs, 32);
+  }
+  throughput<dlib::Spsc_ring<size_t>>("Spsc_ring", 1, 1);
+  throughput<dlib::Spsc_ring<size_t>>("Spsc_ring, push_n/pop_n 32", 1, 32);
+}
+
+DLIB_BENCHMARK(queue_latency) {
+  latency<dlib::Mpmc_queue<size_t>>("Mpmc_queue");
+  latency<dlib::Spsc_ring<size_t>>("Spsc_ring");
+}
@@ -0,0 +1,155 @@
+#include "bench_framework.hpp"
+
+#include <dlib/raft_memory.hpp>
+
+#include <memory>
+
+#if __has_include(<unistd.h>)
+#include <unistd.h>
+#define DLIB_BENCH_FSYNC 1
+#endif
+
+namespace {
+  constexpr size_t entries = 50000;
+  constexpr size_t entry_size = 64;
+  //proposals between each hop of the network
+  constexpr size_t proposals_per_hop = 32;
+
+  /*
+  A hop delivers everything in flight, so with a real network each costs
+  half a round trip: entries per hop is the throughput we'd get when the
+  round trip dominates.
+  */
+  void report(std::string_view benchmark, std::string_view variant, double entries_per_sec, double entries_per_hop, double rpcs_per_entry) noexcept {
+    std::printf("%-24.*s %-28.*s %12.0f entries/s %10.2f entries/hop %8.3f AppendEntries/entry\n",
+      static_cast<int>(benchmark.size()), benchmark.data(),
+      static_cast<int>(variant.size()), variant.data(),
+      entries_per_sec,
+      entries_per_hop,
+      rpcs_per_entry);
+  }
+
+  /*a 3 node cluster, the leader taking a steady stream of proposals*/
+  void replicate(std::string_view benchmark, size_t max_entries, size_t max_in_flight) {
+    dlib::raft::ReplicationOptions replication;
+    replication.maxEntries = max_entries;
+    replication.maxInFlight = max_in_flight;
+    dlib::raft::MemoryCluster cluster{ 3, replication };
+    const dlib::raft::NodeId leader = cluster.elect(1);
+    const uint64_t before = cluster.appendEntriesSent();
+    std::vector<std::byte> data(entry_size);
+    size_t hops = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < entries; ++i) {
+      data[0] = static_cast<std::byte>(i);
+      cluster.node(leader).propose(data);
+      if (i % proposals_per_hop == proposals_per_hop - 1) {
+        cluster.deliver(cluster.pending());
+        ++hops;
+      }
+    }
+    while (cluster.pending() != 0) {
+      cluster.deliver(cluster.pending());
+      ++hops;
+    }
+    const std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+
+    const std::string variant = "maxEntries=" + std::to_string(max_entries) + " maxInFlight=" + std::to_string(max_in_flight);
+    report(benchmark, variant,
+      static_cast<double>(entries) / took.count(),
+      static_cast<double>(entries) / static_cast<double>(hops),
+      static_cast<double>(cluster.appendEntriesSent() - before) / static_cast<double>(entries));
+  }
+}
+
+DLIB_BENCHMARK(raft_batching) {
+  for (size_t max_entries : { 1, 4, 16, 64, 256 }) {
+    replicate("raft_batching", max_entries, 1);
+  }
+}
+
+DLIB_BENCHMARK(raft_pipelining) {
+  for (size_t max_in_flight : { 1, 2, 4, 8 }) {
+    replicate("raft_pipelining", 16, max_in_flight);
+  }
+}
+
+namespace {
+  constexpr size_t durable_entries = 2000;
+
+  /*a file standing in for a node's log on disk, each flush writing a record and syncing it*/
+  class Durable_file {
+  public:
+    Durable_file() noexcept :
+      file_{ std::tmpfile() } {
+
+    }
+    Durable_file(Durable_file const&) = delete;
+    Durable_file& operator=(Durable_file const&) = delete;
+    ~Durable_file() noexcept {
+      if (file_ != nullptr) {
+        std::fclose(file_);
+      }
+    }
+
+    void flush() noexcept {
+      if (file_ == nullptr) {
+        return;
+      }
+      const char record[entry_size] = {};
+      std::fwrite(record, 1, sizeof(record), file_);
+      std::fflush(file_);
+#ifdef DLIB_BENCH_FSYNC
+      ::fsync(::fileno(file_));
+#endif
+    }
+  private:
+    std::FILE* file_;
+  };
+
+  /*a 3 node cluster with each flush going to disk, the leader taking proposals a hop's worth at a time*/
+  void replicate_durably(bool group_commit) {
+    dlib::raft::ReplicationOptions replication;
+    replication.groupCommit = group_commit;
+    dlib::raft::MemoryCluster cluster{ 3, replication };
+    std::vector<std::unique_ptr<Durable_file>> files;
+    for (dlib::raft::NodeId id = 1; id <= cluster.size(); ++id) {
+      files.push_back(std::make_unique<Durable_file>());
+      Durable_file* file = files.back().get();
+      cluster.node(id).driver().onFlush([file]() { file->flush(); });
+    }
+    const dlib::raft::NodeId leader = cluster.elect(1);
+    uint64_t flushes_before = 0;
+    for (dlib::raft::NodeId id = 1; id <= cluster.size(); ++id) {
+      flushes_before += cluster.node(id).driver().flushes();
+    }
+    std::vector<std::byte> data(entry_size);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < durable_entries; ++i) {
+      data[0] = static_cast<std::byte>(i);
+      cluster.node(leader).propose(data);
+      if (i % proposals_per_hop == proposals_per_hop - 1) {
+        cluster.deliver(cluster.pending());
+      }
+    }
+    cluster.settle();
+    const std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+
+    uint64_t flushes = 0;
+    for (dlib::raft::NodeId id = 1; id <= cluster.size(); ++id) {
+      flushes += cluster.node(id).driver().flushes();
+    }
+    std::printf("%-24s %-28s %12.0f appends/s %10.3f flushes/append\n",
+      "raft_group_commit",
+      group_commit ? "groupCommit" : "flush each change",
+      static_cast<double>(durable_entries) / took.count(),
+      static_cast<double>(flushes - flushes_before) / static_cast<double>(durable_entries));
+  }
+}
+
+DLIB_BENCHMARK(raft_group_commit) {
+  replicate_durably(false);
+  replicate_durably(true);
+}
@@ -25,6 +25,21 @@ namespace dlib {
       static constexpr bool found = true;
     };
 
+    template<typename T, template<T> typename Target, T default_, typename ...Options>
+    struct Get_value_impl {
+      static constexpr T value = default_;
+    };
+
+    template<typename T, template<T> typename Target, T default_, typename First, typename ...Rest>
+    struct Get_value_impl<T, Target, default_, First, Rest...> {
+      static constexpr T value = Get_value_impl<T, Target, default_, Rest...>::value;
+    };
+
+    template<typename T, template<T> typename Target, T default_, T found, typename ...Rest>
+    struct Get_value_impl<T, Target, default_, Target<found>, Rest...> {
+      static constexpr T value = found;
+    };
+
     template<typename Type, typename Checking>
     constexpr bool is_get = std::is_same_v<Type, std::decay_t<Checking>>;
     template<template<typename...> typename Type, typename Checking>
@@ -152,4 +167,17 @@ namespace dlib {
   template<template<typename...> typename Target, typename ...Options>
   using Get_arg = ::std::enable_if_t<args_impl::GetImpl<Target, void, Options...>::found,
     typename args_impl::GetImpl<Target, void, Options...>::type>;
+
+  /*
+  Same as Get_arg_defaulted, but for named template arguments holding a value:
+    do_stuff<Times<10>>()
+
+  template<typename ...Ins>
+  auto do_stuff() {
+    constexpr size_t times = value_arg_defaulted<size_t, Times, 1, Ins...>;
+  }
+  */
+
+  template<typename T, template<T> typename Target, T default_, typename ...Options>
+  constexpr T value_arg_defaulted = args_impl::Get_value_impl<T, Target, default_, Options...>::value;
 }
\ No newline at end of file
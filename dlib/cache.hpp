@@ -2,21 +2,370 @@
 
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <array>
+#include <deque>
 #include <vector>
 #include <unordered_map>
 #include <optional>
+#include <functional>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include <utility>
+#include <type_traits>
 #include <cassert>
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <iterator>
+
+#if __has_include(<sys/mman.h>)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define DLIB_CACHE_MMAP 1
+#endif
 
 #include <dlib/args.hpp>
 #include <dlib/outcome.hpp>
+#include <dlib/arrays.hpp>
 #include <dlib/pointer_to.hpp>
 #include <dlib/finder_interface.hpp>
 #include <dlib/concurrency.hpp>
+#include <dlib/eviction.hpp>
+#include <dlib/stats.hpp>
+#include <dlib/numa.hpp>
+#include <dlib/serialization.hpp>
 
 namespace dlib {
+  /*How many independently locked shards a cache splits its keys over*/
+  template<size_t>
+  struct Shards_is {};
+
+  /*Where a cache gets the time from when lines expire, defaults to std::chrono::steady_clock*/
+  template<typename>
+  struct Clock_is;
+
+  /*What a line costs against a cache's capacity, see Unit_weigher*/
+  template<typename>
+  struct Weigher_is;
+
+  /*
+  Every line weighs 1, so capacity counts lines. A weigher is a default
+  constructible type with size_t operator()(Value const&), returning what
+  the value costs (say, its size in bytes) against the capacity.
+  */
+  struct Unit_weigher {
+    template<typename Value>
+    constexpr size_t operator()(Value const&) const noexcept {
+      return 1;
+    }
+  };
+
+  /*How shallow reads find their line*/
+  template<typename>
+  struct Reads_is;
+
+  /*Every read takes its shard's lock*/
+  struct Locked_reads {
+    template<typename Key, typename Cache_line, typename Time, typename Concurrency>
+    class Index {
+    public:
+      static constexpr bool lock_free = false;
+
+      void set(Key const&, Cache_line const&, Time) noexcept {
+
+      }
+
+      void erase(Key const&) noexcept {
+
+      }
+
+      template<typename Lines>
+      void assign(Lines const&) noexcept {
+
+      }
+    };
+  };
+
+  /*
+  Reads never lock. Each key gets a slot whose line is swapped atomically,
+  and the key -> slot map is immutable, republished when a key is added or
+  removed. It's a base map plus the keys changed since, and only those get
+  copied on a publish. Once there are about sqrt(keys) of them they're
+  folded into a new base, so a new key or an erase costs O(sqrt(keys))
+  amortised, rather than a copy of the shard. Old copies are freed when the
+  last reader holding them lets go. That's still dearer than Locked_reads
+  when keys come and go a lot, so this is for read mostly caches.
+  */
+  struct Snapshot_reads {
+    template<typename Key, typename Cache_line, typename Time, typename Concurrency>
+    class Index {
+    public:
+      static constexpr bool lock_free = true;
+
+      /*past fresh_until the line is stale, and readers have to take the lock*/
+      struct Entry {
+        Cache_line line;
+        Time fresh_until;
+      };
+
+      Index() :
+        published_{ std::make_shared<const Published>(Published{ std::make_shared<const Slots>(), Slots{} }) } {
+
+      }
+
+      /*writers call this with the shard's lock held*/
+      void set(Key const& key, Cache_line line, Time fresh_until) noexcept {
+        auto entry = std::make_shared<const Entry>(Entry{ std::move(line), fresh_until });
+        Published const& current = *published_;
+        Slot const* const found = find_(current, key);
+        if (found != nullptr) {
+          Concurrency::atomic_store(found->get(), std::move(entry));
+          return;
+        }
+
+        Published updated{ current.base, current.recent };
+        updated.recent.insert_or_assign(key, std::make_shared<std::shared_ptr<const Entry>>(std::move(entry)));
+        publish_(std::move(updated));
+      }
+
+      /*writers call this with the shard's lock held*/
+      void erase(Key const& key) noexcept {
+        Published const& current = *published_;
+        if (find_(current, key) == nullptr) {
+          return;
+        }
+
+        Published updated{ current.base, current.recent };
+        if (current.base->count(key) != 0) {
+          //still in the base, so it has to be marked gone
+          updated.recent.insert_or_assign(key, nullptr);
+        } else {
+          updated.recent.erase(key);
+        }
+        publish_(std::move(updated));
+      }
+
+      /*writers call this with the shard's lock held, rebuilds everything in one publish*/
+      template<typename Lines>
+      void assign(Lines const& lines) noexcept {
+        auto base = std::make_shared<Slots>();
+        base->reserve(lines.size());
+        for (auto const& line : lines) {
+          base->emplace(line.first, std::make_shared<std::shared_ptr<const Entry>>(
+            std::make_shared<const Entry>(Entry{ line.second.line, line.second.stale_at })));
+        }
+        Concurrency::atomic_store(&published_, std::make_shared<const Published>(Published{ std::move(base), Slots{} }));
+      }
+
+      std::shared_ptr<const Entry> read(Key const& key) const noexcept {
+        const std::shared_ptr<const Published> snapshot = Concurrency::atomic_load(&published_);
+        Slot const* const found = find_(*snapshot, key);
+        if (found == nullptr) {
+          return nullptr;
+        }
+        return Concurrency::atomic_load(found->get());
+      }
+    private:
+      using Slot = std::shared_ptr<std::shared_ptr<const Entry>>;
+      using Slots = std::unordered_map<Key, Slot>;
+
+      struct Published {
+        std::shared_ptr<const Slots> base;
+        //added or removed since base was built, removed ones have a null slot
+        Slots recent;
+      };
+
+      //below this many recent changes, folding them in isn't worth it however small the base
+      static constexpr size_t min_recent_ = 16;
+
+      static Slot const* find_(Published const& published, Key const& key) noexcept {
+        const auto recent = published.recent.find(key);
+        if (recent != published.recent.end()) {
+          return recent->second ? &recent->second : nullptr;
+        }
+        const auto found = published.base->find(key);
+        return found == published.base->end() ? nullptr : &found->second;
+      }
+
+      void publish_(Published updated) noexcept {
+        const size_t recent = updated.recent.size();
+        if (recent >= min_recent_ && recent * recent >= updated.base->size()) {
+          auto base = std::make_shared<Slots>(*updated.base);
+          for (auto& [key, slot] : updated.recent) {
+            if (slot) {
+              base->insert_or_assign(key, std::move(slot));
+            } else {
+              base->erase(key);
+            }
+          }
+          updated.base = std::move(base);
+          updated.recent.clear();
+        }
+        Concurrency::atomic_store(&published_, std::make_shared<const Published>(std::move(updated)));
+      }
+
+      std::shared_ptr<const Published> published_;
+    };
+  };
+
   namespace cache_impl {
 
-    template<typename Key_, typename Value_, typename Concurrency_, typename Pointer_>
+    /*spreads the bits of a std::hash, so shard selection doesn't line up with the buckets inside a shard*/
+    constexpr uint64_t mix_hash(uint64_t h) noexcept {
+      h ^= h >> 33;
+      h *= 0xff51afd7ed558ccdULL;
+      h ^= h >> 33;
+      h *= 0xc4ceb9fe1a85ec53ULL;
+      h ^= h >> 33;
+      return h;
+    }
+
+    /*"DLCHSNAP", then the version, then blocks of a line count followed by that many key, value pairs*/
+    constexpr uint64_t snapshot_magic = 0x50414e5348434c44ULL;
+    constexpr uint32_t snapshot_version = 1;
+
+    /*a whole file's bytes, mapped in where we can, read in where we can't*/
+    class Snapshot_file {
+    public:
+      Snapshot_file(Snapshot_file const&) = delete;
+      Snapshot_file(Snapshot_file&& other) noexcept :
+        data_{ std::exchange(other.data_, nullptr) },
+        size_{ std::exchange(other.size_, 0) },
+        read_{ std::move(other.read_) } {
+
+      }
+      Snapshot_file& operator=(Snapshot_file const&) = delete;
+      Snapshot_file& operator=(Snapshot_file&&) = delete;
+      ~Snapshot_file() noexcept {
+#ifdef DLIB_CACHE_MMAP
+        if (read_.empty() && data_ != nullptr) {
+          munmap(const_cast<std::byte*>(data_), size_);
+        }
+#endif
+      }
+
+      static Result<Snapshot_file> open(std::string const& path) noexcept {
+#ifdef DLIB_CACHE_MMAP
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+          return error("couldn't open snapshot");
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+          ::close(fd);
+          return error("couldn't stat snapshot");
+        }
+        const size_t size = static_cast<size_t>(info.st_size);
+        if (size == 0) {
+          ::close(fd);
+          return Snapshot_file{ nullptr, 0, {} };
+        }
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+          return error("couldn't map snapshot");
+        }
+        //we go through it once, front to back
+        madvise(mapped, size, MADV_SEQUENTIAL);
+        return Snapshot_file{ static_cast<const std::byte*>(mapped), size, {} };
+#else
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (file == nullptr) {
+          return error("couldn't open snapshot");
+        }
+        std::vector<std::byte> read;
+        std::byte buffer[1 << 16];
+        size_t got;
+        while ((got = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+          read.insert(read.end(), buffer, buffer + got);
+        }
+        const bool failed = std::ferror(file) != 0;
+        std::fclose(file);
+        if (failed) {
+          return error("couldn't read snapshot");
+        }
+        const std::byte* data = read.data();
+        const size_t size = read.size();
+        return Snapshot_file{ data, size, std::move(read) };
+#endif
+      }
+
+      const std::byte* begin() const noexcept {
+        return data_;
+      }
+
+      const std::byte* end() const noexcept {
+        return data_ + size_;
+      }
+    private:
+      Snapshot_file(const std::byte* data, size_t size, std::vector<std::byte> read) noexcept :
+        data_{ data },
+        size_{ size },
+        read_{ std::move(read) } {
+
+      }
+
+      const std::byte* data_;
+      size_t size_;
+      //only used when we couldn't map the file, data_ points into it
+      std::vector<std::byte> read_;
+    };
+
+    template<typename Counter>
+    void increment_counter(Counter& counter) noexcept {
+      if constexpr (std::is_arithmetic_v<Counter>) {
+        ++counter;
+      } else {
+        counter.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+
+    template<typename Counter>
+    uint64_t load_counter(Counter const& counter) noexcept {
+      if constexpr (std::is_arithmetic_v<Counter>) {
+        return counter;
+      } else {
+        return counter.load(std::memory_order_relaxed);
+      }
+    }
+
+    /*a counter that copies by value, for counting inside lines that get copied*/
+    template<typename Concurrency>
+    class Copyable_counter {
+    public:
+      Copyable_counter() = default;
+      Copyable_counter(Copyable_counter const& other) noexcept :
+        count_{ load_counter(other.count_) } {
+
+      }
+      Copyable_counter& operator=(Copyable_counter const& other) noexcept {
+        take();
+        count_ += load_counter(other.count_);
+        return *this;
+      }
+
+      void increment() noexcept {
+        increment_counter(count_);
+      }
+
+      /*the count so far, starting it over from zero*/
+      uint64_t take() noexcept {
+        if constexpr (std::is_arithmetic_v<Atomic<Concurrency, uint64_t>>) {
+          return std::exchange(count_, 0);
+        } else {
+          return count_.exchange(0, std::memory_order_relaxed);
+        }
+      }
+    private:
+      Atomic<Concurrency, uint64_t> count_{ 0 };
+    };
+
+    template<typename Key_, typename Value_, typename Concurrency_, typename Pointer_, size_t shard_count_, typename Reads_, typename Eviction_, typename Clock_, typename Weigher_, typename Stats_>
     class Cache :
       protected Get_pointer_from<Pointer_> {
     public:
@@ -26,40 +375,144 @@ namespace dlib {
       using Pointer_to = Get_pointer_to<Pointer_arg, Cache>;
       using Holder = Get_holder<Pointer_arg, Cache>;
       using Concurrency_arg = Concurrency_;
-      using Mutex = Mutex<Concurrency_arg>;
+      using Mutex = ::dlib::Mutex<Concurrency_arg>;
 
       using Cache_line = std::shared_ptr<const Value>;
       using Source = Finder_interface<Key, std::shared_ptr<const Value>>;
 
-      Cache() = default;
-      Cache(Cache const& cache) noexcept {
+      using Reads_arg = Reads_;
+      using Eviction_arg = Eviction_;
+      using Clock_arg = Clock_;
+      using Weigher_arg = Weigher_;
+      using Stats_arg = Stats_;
+      using Duration = typename Clock_arg::duration;
+      using Time = typename Clock_arg::time_point;
+
+      static constexpr size_t shard_count = shard_count_;
+      static_assert(shard_count > 0, "a cache needs at least one shard");
+
+      static constexpr size_t unbounded = std::numeric_limits<size_t>::max();
+
+      /*
+      Background refreshes of stale hits that run at once, the rest queue
+      behind them. Each is a spawned task, a thread of its own with Std_concurrency.
+      */
+      static constexpr size_t max_refreshers = 4;
+
+      struct Counters {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+      };
+
+      /*sources are in the order they were added, all zeros if the stats policy counts nothing*/
+      struct Statistics {
+        Counters counters;
+        size_t entries;
+        Lock_stats locks;
+        std::vector<Source_stats> sources;
+      };
+
+      /*what we're holding, weight is in the weigher's units, largest is heaviest first*/
+      struct Footprint {
+        size_t weight;
+        size_t entries;
+        std::vector<std::pair<Key, size_t>> largest;
+      };
+
+      /*
+      How long a line lives after it was set or fetched. Past soft a read still
+      gets the line, but it also queues one background refresh from the sources.
+      Past hard the line is gone and reads go to the sources themselves.
+      */
+      struct Ttl {
+        Duration soft;
+        Duration hard;
+      };
+
+      static constexpr Ttl forever{ Duration::max(), Duration::max() };
+
+      /*
+      Refreshing ahead: lines read at least hot_reads times since the last sweep,
+      that go stale within ahead, are fetched again before anyone has to wait on
+      them. At most workers fetches run at once. An ahead of forever refreshes
+      hot lines every sweep, whether they expire or not.
+      */
+      struct Refresh_ahead {
+        Duration ahead;
+        uint64_t hot_reads;
+        size_t workers;
+      };
+
+      Cache() :
+        Cache{ unbounded } {
+
+      }
+      /*capacity is the most weight (by default, lines) we keep, split evenly over the shards*/
+      explicit Cache(size_t capacity) :
+        Cache{ capacity, forever } {
+
+      }
+      Cache(size_t capacity, Ttl ttl) :
+        capacity_{ capacity },
+        ttl_{ ttl },
+        sources_{ std::make_shared<Sources>() } {
+        for (Shard& shard : shards_) {
+          shard.eviction.emplace(shard_capacity_());
+        }
+      }
+      Cache(Cache const& cache) noexcept :
+        Cache{ cache.capacity_, cache.ttl_ } {
         *this = cache;
       }
-      Cache(Cache&& cache) noexcept {
+      Cache(Cache&& cache) noexcept :
+        Cache{ cache.capacity_, cache.ttl_ } {
         *this = std::move(cache);
       }
+      /*background refreshes point back at us*/
+      ~Cache() noexcept {
+        stop_refreshing_ahead();
+        std::unique_lock lock{ refreshes_mutex_ };
+        refreshes_done_.wait(lock, [this]() { return refreshes_ == 0 && refreshers_ == 0; });
+      }
       Cache& operator=(Cache const& cache) noexcept {
-        std::scoped_lock lock{ mutex_, cache.mutex_ };
-        lines_ = cache.lines_;
+        capacity_ = cache.capacity_;
+        ttl_ = cache.ttl_;
+        for (size_t i = 0; i < shard_count; ++i) {
+          std::scoped_lock lock{ shards_[i].mutex, cache.shards_[i].mutex };
+          shards_[i].lines = cache.shards_[i].lines;
+          rebuild_(shards_[i]);
+        }
+        std::scoped_lock lock{ sources_mutex_, cache.sources_mutex_ };
         sources_ = cache.sources_;
         return *this;
       }
       Cache& operator=(Cache&& cache) noexcept {
-        std::scoped_lock lock{ mutex_, cache.mutex_ };
-        lines_ = std::move(cache.lines_);
-        sources_ = std::move(cache.sources_);
+        capacity_ = cache.capacity_;
+        ttl_ = cache.ttl_;
+        for (size_t i = 0; i < shard_count; ++i) {
+          std::scoped_lock lock{ shards_[i].mutex, cache.shards_[i].mutex };
+          shards_[i].lines = std::move(cache.shards_[i].lines);
+          rebuild_(shards_[i]);
+          cache.shards_[i].lines.clear();
+          rebuild_(cache.shards_[i]);
+        }
+        std::scoped_lock lock{ sources_mutex_, cache.sources_mutex_ };
+        sources_ = cache.sources_;
         return *this;
       }
 
       void add_source(Source source) {
-        std::lock_guard{ mutex_ };
-        sources_.emplace_back(std::move(source));
+        std::lock_guard lock{ sources_mutex_ };
+        //readers hold on to the old list while they walk it, so we publish a new one instead of changing it
+        auto updated = std::make_shared<Sources>(*sources_);
+        updated->push_back(Backing{ std::move(source), std::make_shared<typename Stats::Source>() });
+        Concurrency_arg::atomic_store(&sources_, std::move(updated));
       }
 
       template<typename Instance, typename ...Overrides>
       void add_source(Instance instance, Overrides&&... overrides) {
-        std::lock_guard{ mutex_ };
-        sources_.emplace_back(Source{ std::move(instance), std::forward<Overrides>(overrides)... });
+        add_source(Source{ std::move(instance), std::forward<Overrides>(overrides)... });
       }
 
       Result<Cache_line> read(Key const& key) noexcept {
@@ -69,98 +522,717 @@ namespace dlib {
 
       /*Try and read current, if that fails, read through*/
       Result<Cache_line> deep_read(Key const& key) noexcept {
-        std::lock_guard{ mutex_ };
-        auto current = read_(key);
+        Shard& shard = shard_(key);
+        if constexpr (Index::lock_free) {
+          const auto published = shard.index.read(key);
+          if (published && fresh_(published->fresh_until)) {
+            increment_counter(shard.hits);
+            return published->line;
+          }
+        }
+        if constexpr (shared_reads) {
+          auto shared = get_lock_<std::shared_lock>(shard);
+          auto hit = read_shared_(shard, key);
+          if (hit && *hit) {
+            return std::move(*hit);
+          }
+        }
+        auto lock = get_lock_(shard);
+        std::shared_ptr<Fetch> refresh;
+        auto current = read_(shard, key, refresh);
         if (current) {
-          return std::move(current);
+          lock.unlock();
+          refresh_(key, std::move(refresh));
+          return current;
         }
 
-        auto through = read_backing_(key);
-        if (through) {
-          return set_(key, std::move(through.value()));
-        } else {
-          return error("key not found");
+        return fetch_(shard, key, lock);
+      }
+
+      /*
+      deep_read for many keys at once. Hits come from the cache, and all the
+      misses go to each source as a single get_many. Lines come back in the
+      same order as keys, null where no source had the key.
+      */
+      std::vector<Cache_line> read_many(Array_view<const Key> keys) noexcept {
+        std::vector<Cache_line> lines(keys.size());
+
+        //visit the keys shard by shard, so each shard is locked once
+        std::vector<size_t> shard_of(keys.size());
+        std::vector<size_t> order(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+          shard_of[i] = shard_index_(keys[i]);
+          order[i] = i;
         }
+        std::stable_sort(order.begin(), order.end(), [&shard_of](size_t l, size_t r) { return shard_of[l] < shard_of[r]; });
+
+        std::vector<size_t> fetching;
+        std::vector<std::shared_ptr<Fetch>> owned;
+        std::vector<std::pair<size_t, std::shared_ptr<Fetch>>> waiting;
+        std::vector<std::pair<size_t, std::shared_ptr<Fetch>>> refreshing;
+
+        for (size_t begin = 0; begin < order.size();) {
+          const size_t on = shard_of[order[begin]];
+          Shard& shard = shards_[on];
+          auto lock = get_lock_(shard);
+          for (; begin < order.size() && shard_of[order[begin]] == on; ++begin) {
+            const size_t index = order[begin];
+            Key const& key = keys[index];
+
+            std::shared_ptr<Fetch> refresh;
+            auto current = read_(shard, key, refresh);
+            if (current) {
+              lines[index] = std::move(current.value());
+              if (refresh) {
+                refreshing.emplace_back(index, std::move(refresh));
+              }
+              continue;
+            }
+
+            //someone else (or a repeat of this key) is already fetching it
+            const auto in_flight = shard.fetching.find(key);
+            if (in_flight != shard.fetching.end()) {
+              waiting.emplace_back(index, in_flight->second);
+              continue;
+            }
+
+            auto fetch = std::make_shared<Fetch>();
+            shard.fetching.emplace(key, fetch);
+            fetching.push_back(index);
+            owned.push_back(std::move(fetch));
+          }
+        }
+
+        if (!fetching.empty()) {
+          std::vector<Key> missing;
+          missing.reserve(fetching.size());
+          for (size_t index : fetching) {
+            missing.push_back(keys[index]);
+          }
+
+          std::vector<Cache_line> fetched = read_backing_many_(missing);
+
+          for (size_t i = 0; i < fetching.size(); ++i) {
+            Key const& key = keys[fetching[i]];
+            Shard& shard = shard_(key);
+            auto lock = get_lock_(shard);
+            complete_fetch_(shard, key, *owned[i], std::move(fetched[i]));
+            lines[fetching[i]] = owned[i]->line;
+          }
+        }
+
+        //our own fetches are all done, so waiting on repeats of our keys can't deadlock
+        for (auto& [index, fetch] : waiting) {
+          auto lock = get_lock_(shard_(keys[index]));
+          fetch->fetched.wait(lock, [&fetch = fetch]() { return fetch->done; });
+          lines[index] = fetch->line;
+        }
+
+        for (auto& [index, refresh] : refreshing) {
+          refresh_(keys[index], std::move(refresh));
+        }
+
+        return lines;
       }
 
       /*Try and get the current version of a key*/
       Result<Cache_line> shallow_read(Key const& key) noexcept {
-        std::lock_guard{ mutex_ };
-        return read_(key);
+        Shard& shard = shard_(key);
+        if constexpr (Index::lock_free) {
+          const auto published = shard.index.read(key);
+          if (!published) {
+            increment_counter(shard.misses);
+            return error("key not found");
+          }
+          if (fresh_(published->fresh_until)) {
+            increment_counter(shard.hits);
+            return published->line;
+          }
+          //stale or expired, which needs the lock to sort out
+        }
+        if constexpr (shared_reads) {
+          auto shared = get_lock_<std::shared_lock>(shard);
+          auto read = read_shared_(shard, key);
+          if (read) {
+            if (!*read) {
+              increment_counter(shard.misses);
+              return error("key not found");
+            }
+            return std::move(*read);
+          }
+          //stale or expired, which needs the exclusive lock to sort out
+        }
+        auto lock = get_lock_(shard);
+        std::shared_ptr<Fetch> refresh;
+        auto current = read_(shard, key, refresh);
+        lock.unlock();
+        refresh_(key, std::move(refresh));
+        return current;
       }
 
       /*Try and update a single key, if that fails, try and read current*/
       Result<Cache_line> read_through(Key const& key) noexcept {
-        std::lock_guard{ mutex_ };
-        auto through = read_backing_(key);
+        Shard& shard = shard_(key);
+        auto lock = get_lock_(shard);
+        auto through = fetch_(shard, key, lock);
         if (through) {
-          return set_(key, std::move(through.value()));
+          return through;
         }
 
-        return read_(key);
+        std::shared_ptr<Fetch> refresh;
+        auto current = read_(shard, key, refresh);
+        lock.unlock();
+        refresh_(key, std::move(refresh));
+        return current;
       }
 
       /*Set the cached value to be this*/
       Result<Cache_line> set(Key const& key, Value value) noexcept {
-        std::lock_guard{ mutex_ };
-        return set_(key, std::make_shared<const Value>(std::move(value)));
+        return set(key, std::make_shared<const Value>(std::move(value)));
       }
 
       /*Set the cached value to be this*/
       Result<Cache_line> set(Key const& key, std::shared_ptr<const Value> value) noexcept {
-        std::lock_guard{ mutex_ };
-        return set_(key, std::move(value));
+        Shard& shard = shard_(key);
+        auto lock = get_lock_(shard);
+        return set_(shard, key, std::move(value));
       }
 
       /*Construct the cached value using args*/
       template<typename ...Args>
       Result<Cache_line> set(Key const& key, Args&&... args) noexcept {
-        std::lock_guard{ mutex_ };
-        return set_(key, std::make_shared<const Value>(std::forward<Args>(args)...));
+        return set(key, std::make_shared<const Value>(std::forward<Args>(args)...));
+      }
+
+      /*Set the cached value to be this, living for ttl instead of the cache's ttl*/
+      Result<Cache_line> set_with_ttl(Key const& key, Ttl ttl, Value value) noexcept {
+        return set_with_ttl(key, ttl, std::make_shared<const Value>(std::move(value)));
+      }
+
+      /*Set the cached value to be this, living for ttl instead of the cache's ttl*/
+      Result<Cache_line> set_with_ttl(Key const& key, Ttl ttl, std::shared_ptr<const Value> value) noexcept {
+        Shard& shard = shard_(key);
+        auto lock = get_lock_(shard);
+        return set_(shard, key, std::move(value), ttl);
       }
 
       /*remove a key*/
       void flush(Key const& key) noexcept {
-        std::lock_guard{ mutex_ };
-        const auto found = lines_.find(key);
+        Shard& shard = shard_(key);
+        auto lock = get_lock_(shard);
+        const auto found = shard.lines.find(key);
 
-        if (found != lines_.end()) {
-          std::shared_ptr<const Value> setting(nullptr);
-          found->second = std::move(setting);
+        if (found != shard.lines.end()) {
+          erase_(shard, found);
         }
+        invalidate_fetch_(shard, key);
       }
 
       /*remove all keys*/
       void flush() noexcept {
-        std::lock_guard{ mutex_ };
-        std::shared_ptr<const Value> setting(nullptr);
+        for (Shard& shard : shards_) {
+          auto lock = get_lock_(shard);
+          shard.eviction->clear();
+          shard.lines.clear();
+          shard.weight = 0;
+          for (auto& fetching : shard.fetching) {
+            fetching.second->invalidated = true;
+          }
+          shard.fetching.clear();
+          //one publish per shard, not per line
+          shard.index.assign(shard.lines);
+        }
+      }
 
-        for (auto&& line : lines_) {
-          line.second = std::move(setting);
+      /*
+      One refresh ahead sweep over every shard, returns how many lines it fetched.
+      Read counts start over after each sweep.
+      */
+      size_t refresh_ahead(Refresh_ahead const& options) noexcept {
+        std::vector<std::pair<Key, std::shared_ptr<Fetch>>> due;
+        const Time now = Clock_arg::now();
+        for (Shard& shard : shards_) {
+          auto lock = get_lock_(shard);
+          for (auto& [key, line] : shard.lines) {
+            const uint64_t reads = line.reads.take();
+            if (reads < options.hot_reads || !due_(line, now, options.ahead) || shard.fetching.count(key) != 0) {
+              continue;
+            }
+            auto fetch = std::make_shared<Fetch>();
+            shard.fetching.emplace(key, fetch);
+            due.emplace_back(key, std::move(fetch));
+          }
+        }
+
+        //the workers take the next due line until there are none left, we're one of them
+        Mutex claiming;
+        size_t next = 0;
+        const auto work = [this, &due, &claiming, &next]() {
+          for (;;) {
+            size_t claimed;
+            {
+              std::lock_guard lock{ claiming };
+              if (next == due.size()) {
+                return;
+              }
+              claimed = next++;
+            }
+            auto& [key, fetch] = due[claimed];
+            auto through = read_backing_(key);
+            Shard& shard = shard_(key);
+            auto lock = get_lock_(shard);
+            complete_fetch_(shard, key, *fetch, through ? std::move(through.value()) : nullptr);
+          }
+        };
+
+        const size_t helpers = std::min(std::max<size_t>(options.workers, 1), due.size()) - (due.empty() ? 0 : 1);
+        //waiting on the group runs helpers nobody's got to yet, so a pool with no other free worker can't leave us stuck
+        Task_group<Concurrency_arg> helping;
+        for (size_t i = 0; i < helpers; ++i) {
+          Concurrency_arg::spawn(helping, [&work]() { work(); });
         }
+        work();
+        Concurrency_arg::wait(helping);
+        return due.size();
       }
-    
+
+      /*
+      Runs refresh_ahead every period on a background thread, until
+      stop_refreshing_ahead or we go away. Restarting replaces the options.
+      The thread is our own rather than a pool task, it spends most of its
+      time asleep and a pool worker stuck waiting with it is one fewer to run
+      the refreshes it hands out.
+      */
+      void start_refreshing_ahead(Duration period, Refresh_ahead options) noexcept {
+        static_assert(!std::is_same_v<Concurrency_arg, Null_concurrency>, "refreshing ahead in the background needs threads");
+        stop_refreshing_ahead();
+        {
+          std::lock_guard lock{ refreshes_mutex_ };
+          stop_refreshing_ahead_ = false;
+        }
+        refresher_ = std::thread{ [this, period, options]() {
+          std::unique_lock lock{ refreshes_mutex_ };
+          for (;;) {
+            if (refreshes_done_.wait_for(lock, period, [this]() { return stop_refreshing_ahead_; })) {
+              return;
+            }
+            lock.unlock();
+            refresh_ahead(options);
+            lock.lock();
+          }
+        } };
+      }
+
+      void stop_refreshing_ahead() noexcept {
+        {
+          std::lock_guard lock{ refreshes_mutex_ };
+          stop_refreshing_ahead_ = true;
+          refreshes_done_.notify_all();
+        }
+        if (refresher_.joinable()) {
+          refresher_.join();
+        }
+      }
+
+      /*
+      Writes every line to path, so a later load_snapshot can start warm.
+      Key and Value have to be serializable by dlib::serialization. Written
+      next to path first and then renamed over it, so path is never half written.
+      */
+      Result<void> save_snapshot(std::string const& path) const noexcept {
+        const std::string writing_path = path + ".writing";
+        std::FILE* file = std::fopen(writing_path.c_str(), "wb");
+        if (file == nullptr) {
+          return error("couldn't open snapshot");
+        }
+
+        std::vector<std::byte> buffer;
+        serialization::serialize(std::back_inserter(buffer), snapshot_magic, snapshot_version);
+        bool written = std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+
+        //a block per shard, serialized under its lock and written out after
+        for (Shard const& shard : shards_) {
+          if (!written) {
+            break;
+          }
+          buffer.clear();
+          {
+            auto lock = get_lock_(shard);
+            uint64_t count = 0;
+            for (auto const& line : shard.lines) {
+              count += line.second.line ? 1 : 0;
+            }
+            auto out = serialization::serialize(std::back_inserter(buffer), count);
+            for (auto const& [key, line] : shard.lines) {
+              if (line.line) {
+                out = serialization::serialize(std::move(out), key, *line.line);
+              }
+            }
+          }
+          written = std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+        }
+
+        written = std::fclose(file) == 0 && written;
+        if (!written || std::rename(writing_path.c_str(), path.c_str()) != 0) {
+          std::remove(writing_path.c_str());
+          return error("couldn't write snapshot");
+        }
+        return success;
+      }
+
+      /*
+      Sets every line from a save_snapshot file, returns how many. Lines get
+      our ttl as if they were just fetched.
+      */
+      Result<size_t> load_snapshot(std::string const& path) noexcept {
+        DLIB_TRY(file, (Snapshot_file::open(path)));
+        const std::byte* on = file.begin();
+        const std::byte* const end = file.end();
+
+        DLIB_TRY(magic, (serialization::deserialize<uint64_t>(on, end)));
+        DLIB_TRY(version, (serialization::deserialize<uint32_t>(magic.iter, end)));
+        if (magic.val != snapshot_magic || version.val != snapshot_version) {
+          return error("not a cache snapshot");
+        }
+        on = version.iter;
+
+        size_t loaded = 0;
+        while (on != end) {
+          DLIB_TRY(count, (serialization::deserialize<uint64_t>(on, end)));
+          on = count.iter;
+          for (uint64_t i = 0; i < count.val; ++i) {
+            DLIB_TRY(key, (serialization::deserialize<Key>(on, end)));
+            DLIB_TRY(value, (serialization::deserialize<Value>(key.iter, end)));
+            on = value.iter;
+            set(key.val, std::make_shared<const Value>(std::move(value.val)));
+            ++loaded;
+          }
+        }
+        return loaded;
+      }
+
+      /*how many lines we are holding*/
+      size_t size() const noexcept {
+        size_t total = 0;
+        for (Shard const& shard : shards_) {
+          auto lock = get_lock_(shard);
+          total += shard.lines.size();
+        }
+        return total;
+      }
+
+      size_t capacity() const noexcept {
+        return capacity_;
+      }
+
+      Ttl ttl() const noexcept {
+        return ttl_;
+      }
+
+      /*how much we're holding, and the largest lines by weight*/
+      Footprint footprint(size_t largest = 8) const noexcept {
+        Footprint total{ 0, 0, {} };
+        const auto heavier = [](auto const& l, auto const& r) { return l.second > r.second; };
+        //a min heap of the heaviest we've seen, so the lightest of them is the one to replace
+        auto& heaviest = total.largest;
+        heaviest.reserve(largest);
+        for (Shard const& shard : shards_) {
+          auto lock = get_lock_(shard);
+          total.weight += shard.weight;
+          total.entries += shard.lines.size();
+          if (largest == 0) {
+            continue;
+          }
+          for (auto const& [key, line] : shard.lines) {
+            if (heaviest.size() < largest) {
+              heaviest.emplace_back(key, line.weight);
+              std::push_heap(heaviest.begin(), heaviest.end(), heavier);
+            } else if (line.weight > heaviest.front().second) {
+              std::pop_heap(heaviest.begin(), heaviest.end(), heavier);
+              heaviest.back() = { key, line.weight };
+              std::push_heap(heaviest.begin(), heaviest.end(), heavier);
+            }
+          }
+        }
+        std::sort_heap(heaviest.begin(), heaviest.end(), heavier);
+        return total;
+      }
+
+      Statistics statistics() const noexcept {
+        Statistics total{ counters(), size(), stats_.load(), {} };
+        const std::shared_ptr<Sources> sources = Concurrency_arg::atomic_load(&sources_);
+        for (auto const& backing : *sources) {
+          total.sources.push_back(backing.stats->load());
+        }
+        return total;
+      }
+
+      Counters counters() const noexcept {
+        Counters total{ 0, 0, 0 };
+        for (Shard const& shard : shards_) {
+          total.hits += load_counter(shard.hits);
+          total.misses += load_counter(shard.misses);
+          total.evictions += load_counter(shard.evictions);
+        }
+        return total;
+      }
+
       static Cache make() noexcept {
         return Cache{};
       }
+
+      static Cache make(size_t capacity) noexcept {
+        return Cache{ capacity };
+      }
+
+      static Cache make(size_t capacity, Ttl ttl) noexcept {
+        return Cache{ capacity, ttl };
+      }
     private:
-      Result<Cache_line> read_(Key const& key) const noexcept {
-        const auto found = lines_.find(key);
-        if (found == lines_.end()) {
-          return error("key not found");
+      using Stats = typename Stats_arg::template Type<Concurrency_arg>;
+      using Stopwatch = std::chrono::steady_clock;
+
+      struct Backing {
+        Source source;
+        //shared by every copy of the list
+        std::shared_ptr<typename Stats::Source> stats;
+      };
+
+      using Sources = std::vector<Backing>;
+      using Eviction = typename Eviction_arg::template Type<Key, Concurrency_arg>;
+      using Index = typename Reads_arg::template Index<Key, Cache_line, Time, Concurrency_arg>;
+      using Counter = Atomic<Concurrency_arg, uint64_t>;
+
+      //hits only change the eviction policy, so if it takes concurrent touches they can share the lock
+      static constexpr bool shared_reads = Eviction::concurrent_touch;
+      using Shard_mutex = std::conditional_t<shared_reads, Shared_mutex<Concurrency_arg>, Mutex>;
+      using Shard_condition_variable = std::conditional_t<shared_reads, Condition_variable_any<Concurrency_arg>, Condition_variable<Concurrency_arg>>;
+
+      struct Line :
+        public Eviction::Hook {
+        Line(Cache_line line_, size_t weight_, Time stale_at_, Time expires_at_) noexcept :
+          line{ std::move(line_) },
+          weight{ weight_ },
+          stale_at{ stale_at_ },
+          expires_at{ expires_at_ } {
+
+        }
+        Cache_line line;
+        size_t weight;
+        Time stale_at;
+        Time expires_at;
+        //since the last refresh ahead sweep
+        Copyable_counter<Concurrency_arg> reads;
+      };
+
+      using Lines = std::unordered_map<Key, Line>;
+
+      /*a backing read in flight, everyone missing on the key waits for this instead of starting their own*/
+      struct Fetch {
+        Shard_condition_variable fetched;
+        bool done = false;
+        //set or flushed while we were fetching, what we got is older than what the cache was told
+        bool invalidated = false;
+        Cache_line line;
+      };
+
+      struct alignas(cache_line_size) Shard {
+        mutable Shard_mutex mutex;
+        Lines lines;
+        std::unordered_map<Key, std::shared_ptr<Fetch>> fetching;
+        Index index;
+        //optional so it can be rebuilt with a new capacity, policies aren't copyable
+        std::optional<Eviction> eviction;
+        //of all the lines, against shard_capacity_
+        size_t weight = 0;
+        Counter hits{ 0 };
+        Counter misses{ 0 };
+        Counter evictions{ 0 };
+      };
+
+      static size_t shard_index_(Key const& key) noexcept {
+        if constexpr (shard_count == 1) {
+          return 0;
+        } else {
+          const uint64_t hash = mix_hash(static_cast<uint64_t>(std::hash<Key>{}(key)));
+          return static_cast<size_t>(hash % shard_count);
+        }
+      }
+
+      Shard& shard_(Key const& key) noexcept {
+        return shards_[shard_index_(key)];
+      }
+
+      size_t shard_capacity_() const noexcept {
+        if (capacity_ == unbounded) {
+          return unbounded;
+        }
+        //round up, so a small capacity still leaves every shard room for a line
+        return (capacity_ + shard_count - 1) / shard_count;
+      }
+
+      /*only a lock we had to wait for is timed, Lock is std::shared_lock for readers*/
+      template<template<typename> typename Lock = std::unique_lock>
+      [[nodiscard]]
+      Lock<Shard_mutex> get_lock_(Shard const& shard) const noexcept {
+        if constexpr (Stats::enabled) {
+          Lock<Shard_mutex> lock{ shard.mutex, std::try_to_lock };
+          if (!lock.owns_lock()) {
+            const auto started = Stopwatch::now();
+            lock.lock();
+            stats_.lock_waited(nanoseconds_since_(started));
+          }
+          return lock;
+        } else {
+          return Lock<Shard_mutex>{ shard.mutex };
+        }
+      }
+
+      static Stopwatch::time_point stats_now_() noexcept {
+        if constexpr (Stats::enabled) {
+          return Stopwatch::now();
         } else {
-          auto ptr = found->second;
-          if (ptr) {
-            return ptr;
-          } else {
+          return Stopwatch::time_point{};
+        }
+      }
+
+      static uint64_t nanoseconds_since_(Stopwatch::time_point started) noexcept {
+        if constexpr (Stats::enabled) {
+          return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Stopwatch::now() - started).count());
+        } else {
+          return 0;
+        }
+      }
+
+      /*relinks every line into a fresh policy, after the map was copied or moved in*/
+      void rebuild_(Shard& shard) noexcept {
+        shard.eviction.emplace(shard_capacity_());
+        shard.weight = 0;
+        for (auto& line : shard.lines) {
+          shard.eviction->inserted(line.first, line.second);
+          shard.weight += line.second.weight;
+        }
+        shard.index.assign(shard.lines);
+        evict_(shard);
+      }
+
+      /*lines that never expire are stamped with Time::max(), so they never need the clock*/
+      static bool fresh_(Time until) noexcept {
+        return until == Time::max() || Clock_arg::now() < until;
+      }
+
+      static Time after_(Time now, Duration ttl) noexcept {
+        if (ttl == Duration::max() || now > Time::max() - ttl) {
+          return Time::max();
+        }
+        return now + ttl;
+      }
+
+      /*
+      With the shard's lock held. Expired lines are dropped and read as a miss.
+      A stale line is still returned, and if nobody is fetching the key yet,
+      refresh is set to a fetch the caller has to start with refresh_ once
+      they let go of the lock.
+      Hits served from the snapshot skip this, so aren't reported to the eviction policy or counted for refreshing ahead.
+      */
+      static Result<Cache_line> read_(Shard& shard, Key const& key, std::shared_ptr<Fetch>& refresh) noexcept {
+        const auto found = shard.lines.find(key);
+        if (found == shard.lines.end()) {
+          increment_counter(shard.misses);
+          return error("key not found");
+        }
+        Line& line = found->second;
+        if (!fresh_(line.stale_at)) {
+          if (!fresh_(line.expires_at)) {
+            erase_(shard, found);
+            increment_counter(shard.misses);
             return error("key not found");
           }
+          if (shard.fetching.count(key) == 0) {
+            refresh = std::make_shared<Fetch>();
+            shard.fetching.emplace(key, refresh);
+          }
+        }
+        increment_counter(shard.hits);
+        line.reads.increment();
+        shard.eviction->touched(line);
+        return line.line;
+      }
+
+      /*
+      With the shard's lock held shared, so the lines can't change. A fresh
+      hit is counted and returned, a key we don't have comes back null and
+      uncounted (the caller decides what the miss means), and a stale or
+      expired line comes back nullopt, for read_ to sort out under the
+      exclusive lock.
+      */
+      static std::optional<Cache_line> read_shared_(Shard& shard, Key const& key) noexcept {
+        const auto found = shard.lines.find(key);
+        if (found == shard.lines.end()) {
+          return Cache_line{};
+        }
+        Line& line = found->second;
+        if (!fresh_(line.stale_at)) {
+          return std::nullopt;
         }
+        increment_counter(shard.hits);
+        line.reads.increment();
+        shard.eviction->touched(line);
+        return line.line;
+      }
+
+      static bool due_(Line const& line, Time now, Duration ahead) noexcept {
+        if (ahead == Duration::max()) {
+          return true;
+        }
+        return line.stale_at != Time::max() && line.stale_at - now <= ahead;
+      }
+
+      /*fetches key in the background, and caches it once it's back. Does nothing if refresh is null*/
+      void refresh_(Key const& key, std::shared_ptr<Fetch> refresh) noexcept {
+        if (!refresh) {
+          return;
+        }
+        {
+          std::lock_guard lock{ refreshes_mutex_ };
+          ++refreshes_;
+          waiting_refreshes_.emplace_back(key, std::move(refresh));
+          if (refreshers_ >= max_refreshers) {
+            //one of those already going gets to it
+            return;
+          }
+          ++refreshers_;
+        }
+        Concurrency_arg::spawn([this]() { run_refreshes_(); });
+      }
+
+      /*a refresher, working through the queued refreshes till there are none*/
+      void run_refreshes_() noexcept {
+        std::unique_lock lock{ refreshes_mutex_ };
+        while (!waiting_refreshes_.empty()) {
+          auto [key, refresh] = std::move(waiting_refreshes_.front());
+          waiting_refreshes_.pop_front();
+          lock.unlock();
+          auto through = read_backing_(key);
+          Shard& shard = shard_(key);
+          {
+            auto shard_lock = get_lock_(shard);
+            complete_fetch_(shard, key, *refresh, through ? std::move(through.value()) : nullptr);
+          }
+          lock.lock();
+          --refreshes_;
+        }
+        --refreshers_;
+        refreshes_done_.notify_all();
       }
 
       Result<std::shared_ptr<const Value>> read_backing_(Key const& key) noexcept {
-        for (auto& updater : sources_) {
-          auto updated{ updater.get(key) };
+        //the snapshot keeps the list alive even if a source gets added while we walk it
+        const std::shared_ptr<Sources> sources = Concurrency_arg::atomic_load(&sources_);
+        for (auto& backing : *sources) {
+          const auto started = stats_now_();
+          auto updated{ backing.source.get(key) };
+          backing.stats->fetched(!!updated, nanoseconds_since_(started));
           if (updated) {
             return std::move(updated.value());
           }
@@ -168,25 +1240,295 @@ namespace dlib {
         return error("key not found");
       }
 
-      Cache_line set_(Key const& key, Cache_line ptr) noexcept {
-        const auto found = lines_.find(key);
+      /*
+      Reads key from the sources without holding the shard's lock. Only the
+      first miss on a key goes to the sources, concurrent misses wait on it.
+      lock must be held on entry, and is held again on return.
+      */
+      Result<Cache_line> fetch_(Shard& shard, Key const& key, std::unique_lock<Shard_mutex>& lock) noexcept {
+        const auto in_flight = shard.fetching.find(key);
+        if (in_flight != shard.fetching.end()) {
+          const std::shared_ptr<Fetch> waiting = in_flight->second;
+          waiting->fetched.wait(lock, [&waiting]() { return waiting->done; });
+          if (!waiting->line) {
+            return error("key not found");
+          }
+          return waiting->line;
+        }
+
+        const auto fetch = std::make_shared<Fetch>();
+        shard.fetching.emplace(key, fetch);
+
+        lock.unlock();
+        auto through = read_backing_(key);
+        lock.lock();
+
+        complete_fetch_(shard, key, *fetch, through ? std::move(through.value()) : nullptr);
+
+        if (!fetch->line) {
+          return error("key not found");
+        }
+        return fetch->line;
+      }
+
+      /*with the shard's lock held, hands the fetched line to the waiters and caches it*/
+      void complete_fetch_(Shard& shard, Key const& key, Fetch& fetch, Cache_line fetched) noexcept {
+        //if we were invalidated, someone may have started fetching the key again since
+        const auto in_flight = shard.fetching.find(key);
+        if (in_flight != shard.fetching.end() && in_flight->second.get() == &fetch) {
+          shard.fetching.erase(in_flight);
+        }
+        fetch.done = true;
+        fetch.line = std::move(fetched);
+        if (fetch.line && !fetch.invalidated) {
+          set_(shard, key, fetch.line);
+        }
+        fetch.fetched.notify_all();
+      }
+
+      /*those already waiting on the fetch get what it brings back, anyone after fetches again*/
+      static void invalidate_fetch_(Shard& shard, Key const& key) noexcept {
+        const auto in_flight = shard.fetching.find(key);
+        if (in_flight != shard.fetching.end()) {
+          in_flight->second->invalidated = true;
+          shard.fetching.erase(in_flight);
+        }
+      }
+
+      /*one get_many per source, each only asked for what the ones before it didn't have*/
+      std::vector<Cache_line> read_backing_many_(std::vector<Key> const& keys) noexcept {
+        std::vector<Cache_line> found(keys.size());
+        std::vector<size_t> remaining(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+          remaining[i] = i;
+        }
+
+        const std::shared_ptr<Sources> sources = Concurrency_arg::atomic_load(&sources_);
+        std::vector<Key> asking;
+        std::vector<size_t> still_missing;
+        for (auto& backing : *sources) {
+          if (remaining.empty()) {
+            break;
+          }
+          asking.clear();
+          for (size_t index : remaining) {
+            asking.push_back(keys[index]);
+          }
+
+          const auto started = stats_now_();
+          auto got = backing.source.get_many(Array_view<const Key>{ asking.data(), asking.size() });
+          //every key in the batch is counted as taking the whole batch's time
+          const uint64_t took = nanoseconds_since_(started);
+
+          still_missing.clear();
+          for (size_t i = 0; i < remaining.size(); ++i) {
+            const bool got_it = i < got.size() && got[i];
+            backing.stats->fetched(got_it, took);
+            if (got_it) {
+              found[remaining[i]] = std::move(got[i].value());
+            } else {
+              still_missing.push_back(remaining[i]);
+            }
+          }
+          std::swap(remaining, still_missing);
+        }
+        return found;
+      }
+
+      Cache_line set_(Shard& shard, Key const& key, Cache_line ptr) noexcept {
+        return set_(shard, key, std::move(ptr), ttl_);
+      }
 
-        if (found == lines_.end()) {
-          const auto emplaced = lines_.emplace(key, std::move(ptr)).first;
-          return emplaced->second;
+      Cache_line set_(Shard& shard, Key const& key, Cache_line ptr, Ttl ttl) noexcept {
+        invalidate_fetch_(shard, key);
+        Time stale_at = Time::max();
+        Time expires_at = Time::max();
+        if (ttl.soft != Duration::max() || ttl.hard != Duration::max()) {
+          const Time now = Clock_arg::now();
+          expires_at = after_(now, ttl.hard);
+          stale_at = std::min(after_(now, ttl.soft), expires_at);
+        }
+        const size_t weight = ptr ? Weigher_arg{}(*ptr) : 0;
+        const auto found = shard.lines.find(key);
+
+        if (found == shard.lines.end()) {
+          const auto emplaced = shard.lines.emplace(key, Line{ ptr, weight, stale_at, expires_at }).first;
+          shard.eviction->inserted(emplaced->first, emplaced->second);
+          shard.index.set(key, ptr, stale_at);
         } else {
-          found->second = std::move(ptr);
-          return found->second;
+          shard.weight -= found->second.weight;
+          found->second.line = ptr;
+          found->second.weight = weight;
+          found->second.stale_at = stale_at;
+          found->second.expires_at = expires_at;
+          shard.eviction->touched(found->second);
+          shard.index.set(key, ptr, stale_at);
         }
+        shard.weight += weight;
+        //a heavier value can push us over, even without a new line
+        evict_(shard);
+        return ptr;
       }
-      Mutex mutex_;
-      std::unordered_map<Key, Cache_line> lines_;
-      std::vector<Source> sources_;
+
+      void evict_(Shard& shard) noexcept {
+        if constexpr (Eviction::bounded) {
+          const size_t capacity = shard_capacity_();
+          while (shard.weight > capacity) {
+            const Key* victim = shard.eviction->victim();
+            if (victim == nullptr) {
+              return;
+            }
+            erase_(shard, shard.lines.find(*victim));
+            increment_counter(shard.evictions);
+          }
+        }
+      }
+
+      static void erase_(Shard& shard, typename Lines::iterator erasing) noexcept {
+        shard.eviction->erased(erasing->second);
+        shard.weight -= erasing->second.weight;
+        shard.index.erase(erasing->first);
+        shard.lines.erase(erasing);
+      }
+
+      size_t capacity_;
+      Ttl ttl_;
+      std::array<Shard, shard_count> shards_;
+      Mutex sources_mutex_;
+      std::shared_ptr<Sources> sources_;
+      mutable Stats stats_;
+      //background refreshes queued or running, we wait for these before going away
+      Mutex refreshes_mutex_;
+      Condition_variable<Concurrency_arg> refreshes_done_;
+      size_t refreshes_ = 0;
+      std::deque<std::pair<Key, std::shared_ptr<Fetch>>> waiting_refreshes_;
+      //tasks spawned to run them, at most max_refreshers
+      size_t refreshers_ = 0;
+      std::thread refresher_;
+      bool stop_refreshing_ahead_ = false;
     };
   }
 
   template<typename Key, typename Value, typename ...Args>
   using Cache = cache_impl::Cache<Key, Value,
-    Get_arg_defaulted<Concurrency_is, Std_concurrency, Args...>,
-    Get_arg_defaulted<Pointer_is, Raw_pointer, Args...>>;
-}
\ No newline at end of file
+    First<Get_arg_defaulted<Concurrency_is, List<Std_concurrency>, Args...>>,
+    First<Get_arg_defaulted<Pointer_is, List<Raw_pointer>, Args...>>,
+    value_arg_defaulted<size_t, Shards_is, 1, Args...>,
+    First<Get_arg_defaulted<Reads_is, List<Locked_reads>, Args...>>,
+    First<Get_arg_defaulted<Eviction_is, List<No_eviction>, Args...>>,
+    First<Get_arg_defaulted<Clock_is, List<std::chrono::steady_clock>, Args...>>,
+    First<Get_arg_defaulted<Weigher_is, List<Unit_weigher>, Args...>>,
+    First<Get_arg_defaulted<Stats_is, List<Striped_stats>, Args...>>>;
+
+  /*
+  A Cache per NUMA node, reads go to the calling thread's node. Lines read
+  through are fetched and kept by a thread on that node, so hot keys get a
+  copy on every node that reads them instead of being read across sockets.
+  Sets and flushes go to every node, a value set directly is shared by all
+  of them. Anything else is on the node caches themselves, see node().
+  */
+  template<typename Key, typename Value, typename ...Args>
+  class Numa_cache {
+  public:
+    using Node_cache = Cache<Key, Value, Args...>;
+    using Cache_line = typename Node_cache::Cache_line;
+    using Source = typename Node_cache::Source;
+    using Counters = typename Node_cache::Counters;
+
+    Numa_cache() :
+      Numa_cache{ Node_cache::unbounded } {
+
+    }
+
+    /*every node cache is made with these, so capacity is per node*/
+    template<typename ...Cache_args>
+    explicit Numa_cache(Cache_args const&... args) :
+      nodes_{ make_per_numa_node<Node_cache>([&args...]() { return std::make_unique<Node_cache>(args...); }) } {
+
+    }
+
+    void add_source(Source source) {
+      for (auto& node : nodes_) {
+        node->add_source(source);
+      }
+    }
+
+    template<typename Instance, typename ...Overrides>
+    void add_source(Instance instance, Overrides&&... overrides) {
+      add_source(Source{ std::move(instance), std::forward<Overrides>(overrides)... });
+    }
+
+    Result<Cache_line> read(Key const& key) noexcept {
+      return local_().read(key);
+    }
+
+    Result<Cache_line> deep_read(Key const& key) noexcept {
+      return local_().deep_read(key);
+    }
+
+    Result<Cache_line> shallow_read(Key const& key) noexcept {
+      return local_().shallow_read(key);
+    }
+
+    Result<Cache_line> read_through(Key const& key) noexcept {
+      return local_().read_through(key);
+    }
+
+    Result<Cache_line> set(Key const& key, Value value) noexcept {
+      return set(key, std::make_shared<const Value>(std::move(value)));
+    }
+
+    Result<Cache_line> set(Key const& key, std::shared_ptr<const Value> value) noexcept {
+      for (auto& node : nodes_) {
+        DLIB_TRY((node->set(key, value)));
+      }
+      return Cache_line{ std::move(value) };
+    }
+
+    void flush(Key const& key) noexcept {
+      for (auto& node : nodes_) {
+        node->flush(key);
+      }
+    }
+
+    void flush() noexcept {
+      for (auto& node : nodes_) {
+        node->flush();
+      }
+    }
+
+    /*lines held over every node, a key read on two nodes counts twice*/
+    size_t size() const noexcept {
+      size_t total = 0;
+      for (auto const& node : nodes_) {
+        total += node->size();
+      }
+      return total;
+    }
+
+    Counters counters() const noexcept {
+      Counters total{ 0, 0, 0 };
+      for (auto const& node : nodes_) {
+        const Counters counters = node->counters();
+        total.hits += counters.hits;
+        total.misses += counters.misses;
+        total.evictions += counters.evictions;
+      }
+      return total;
+    }
+
+    size_t node_count() const noexcept {
+      return nodes_.size();
+    }
+
+    Node_cache& node(size_t node) noexcept {
+      return *nodes_[node];
+    }
+  private:
+    Node_cache& local_() noexcept {
+      return *nodes_[current_numa_node()];
+    }
+
+    std::vector<std::unique_ptr<Node_cache>> nodes_;
+  };
+}
@@ -1,15 +1,39 @@
 #pragma once
 #include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
 #include <atomic>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
 #include <dlib/pointer_to.hpp>
 
 namespace dlib {
+  /*what we pad to when we want to keep hot data away from false sharing*/
+  constexpr size_t cache_line_size = 64;
+
   template<typename Concurrency>
   using Mutex = typename Concurrency::Mutex;
 
+  /*lock_shared for readers, lock for writers*/
+  template<typename Concurrency>
+  using Shared_mutex = typename Concurrency::Shared_mutex;
+
   template<typename Concurrency, typename T>
   using Atomic = typename Concurrency::template Atomic<T>;
 
+  /*waits with a std::unique_lock<Mutex<Concurrency>>*/
+  template<typename Concurrency>
+  using Condition_variable = typename Concurrency::Condition_variable;
+
+  /*waits with any lock, such as a std::unique_lock<Shared_mutex<Concurrency>>*/
+  template<typename Concurrency>
+  using Condition_variable_any = typename Concurrency::Condition_variable_any;
+
   template<typename Concurrency, typename T>
   T atomic_load(const Atomic<Concurrency, T>* v) {
     return Concurrency::atomic_load(v);
@@ -23,8 +47,15 @@ namespace dlib {
   template<typename Concurrency, typename T, typename Tag = void>
   using Thread_local = typename Concurrency::template Thread_local<T, Tag>;
 
+  /*wait(group) returns once everything spawn(group, f) started has finished*/
+  template<typename Concurrency>
+  using Task_group = typename Concurrency::Task_group;
+
   struct Std_concurrency {
     using Mutex = std::mutex;
+    using Shared_mutex = std::shared_mutex;
+    using Condition_variable = std::condition_variable;
+    using Condition_variable_any = std::condition_variable_any;
 
     template<typename T>
     using Atomic = std::atomic<T>;
@@ -39,6 +70,54 @@ namespace dlib {
       return std::atomic_store(p, v);
     }
 
+    /*runs f on its own thread, whoever spawns is responsible for outliving it*/
+    template<typename F>
+    static void spawn(F&& f) {
+      std::thread{ std::forward<F>(f) }.detach();
+    }
+
+    /*counts what's been spawned into it and not yet finished*/
+    class Task_group {
+    public:
+      Task_group() = default;
+      Task_group(Task_group const&) = delete;
+      Task_group& operator=(Task_group const&) = delete;
+    private:
+      friend struct Std_concurrency;
+
+      std::mutex mutex_;
+      std::condition_variable done_;
+      size_t left_ = 0;
+    };
+
+    template<typename F>
+    static void spawn(Task_group& group, F&& f) {
+      {
+        std::lock_guard lock{ group.mutex_ };
+        ++group.left_;
+      }
+      spawn([&group, f = std::forward<F>(f)]() mutable {
+        f();
+        std::lock_guard lock{ group.mutex_ };
+        if (--group.left_ == 0) {
+          group.done_.notify_all();
+        }
+      });
+    }
+
+    static void wait(Task_group& group) noexcept {
+      std::unique_lock lock{ group.mutex_ };
+      group.done_.wait(lock, [&group]() { return group.left_ == 0; });
+    }
+
+    /*a thread per call is too dear to split a loop over, so we run it ourselves*/
+    template<typename Index, typename F>
+    static void parallel_for(Index begin, Index end, F&& f) {
+      for (Index i = begin; i < end; ++i) {
+        f(i);
+      }
+    }
+
     template<typename T, typename>
     struct Thread_local {
       static thread_local T t;
@@ -64,11 +143,273 @@ namespace dlib {
       bool try_lock() const noexcept {
         return true;
       }
+
+      constexpr void lock_shared() const noexcept {
+
+      }
+
+      constexpr void unlock_shared() const noexcept {
+
+      }
+
+      bool try_lock_shared() const noexcept {
+        return true;
+      }
+    };
+
+    /*with one thread nobody else can make the predicate true, so waiting is a no-op*/
+    struct Null_condition_variable {
+      template<typename Lock>
+      constexpr void wait(Lock&) const noexcept {
+
+      }
+
+      template<typename Lock, typename Predicate>
+      constexpr void wait(Lock&, Predicate&&) const noexcept {
+
+      }
+
+      template<typename Lock, typename Duration, typename Predicate>
+      constexpr bool wait_for(Lock&, Duration const&, Predicate&& predicate) const noexcept {
+        return predicate();
+      }
+
+      constexpr void notify_one() const noexcept {
+
+      }
+
+      constexpr void notify_all() const noexcept {
+
+      }
     };
   }
 
+  namespace impl {
+    /*tells the core we're spinning, so it can back off and let a hyperthread sibling run*/
+    inline void cpu_relax() noexcept {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+      _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+      asm volatile("yield");
+#endif
+    }
+
+    /*
+    Where parked Spin_mutex lockers sleep. It's keyed by the mutex's address
+    rather than living in it, so an unlock can wake them after letting go,
+    when the mutex may already be gone. Mutexes sharing a spot get each
+    other's wake ups, and just go back to sleep.
+    */
+    struct alignas(cache_line_size) Parking_spot {
+      std::mutex mutex;
+      std::condition_variable parked;
+    };
+
+    inline Parking_spot& parking_spot(void const* address) noexcept {
+      static constexpr size_t spot_count = 64;
+      static Parking_spot spots[spot_count];
+      const uintptr_t key = reinterpret_cast<uintptr_t>(address);
+      return spots[((key >> 4) ^ (key >> 12)) % spot_count];
+    }
+
+    /*
+    Spins with exponential backoff before parking, for critical sections
+    short enough that a futex round trip costs more than they do.
+
+    How long we spin adapts: locks we get while spinning push the budget up,
+    parking pulls it down, so a lock usually held past our spin stops
+    wasting cycles on it.
+    */
+    class Spin_mutex {
+    public:
+      static constexpr uint32_t max_spins = 1000;
+
+      Spin_mutex() = default;
+      Spin_mutex(Spin_mutex const&) = delete;
+      Spin_mutex& operator=(Spin_mutex const&) = delete;
+
+      bool try_lock() noexcept {
+        uint32_t expected = unlocked_;
+        return state_.compare_exchange_strong(expected, locked_, std::memory_order_acquire, std::memory_order_relaxed);
+      }
+
+      void lock() noexcept {
+        if (try_lock()) {
+          return;
+        }
+        const uint32_t budget = spin_budget_.load(std::memory_order_relaxed);
+        const uint32_t limit = std::min(max_spins, budget * 2 + 10);
+        uint32_t spun = 0;
+        for (uint32_t backoff = 1; spun < limit; backoff = std::min<uint32_t>(backoff * 2, 64)) {
+          for (uint32_t i = 0; i < backoff; ++i) {
+            cpu_relax();
+          }
+          spun += backoff;
+          //only try the exchange once it looks free, so spinners don't bounce the line
+          if (state_.load(std::memory_order_relaxed) == unlocked_ && try_lock()) {
+            adapt_(budget, spun);
+            return;
+          }
+        }
+        //spinning didn't get it, so spin less next time
+        spin_budget_.store(budget - (budget + 7) / 8, std::memory_order_relaxed);
+        park_();
+      }
+
+      void unlock() noexcept {
+        //once it's unlocked someone else can take it, free it and destroy us, so only our address is used after
+        const void* const address = this;
+        if (state_.exchange(unlocked_, std::memory_order_release) == contended_) {
+          Parking_spot& spot = parking_spot(address);
+          //taking the spot's mutex orders us after any waiter that saw contended_ and is going to sleep
+          {
+            std::lock_guard lock{ spot.mutex };
+          }
+          spot.parked.notify_all();
+        }
+      }
+
+      /*how long lock() spins before it parks, as it stands*/
+      uint32_t spin_budget() const noexcept {
+        return spin_budget_.load(std::memory_order_relaxed);
+      }
+    private:
+      static constexpr uint32_t unlocked_ = 0;
+      static constexpr uint32_t locked_ = 1;
+      //locked, and someone may be parked waiting for it
+      static constexpr uint32_t contended_ = 2;
+
+      void adapt_(uint32_t budget, uint32_t spun) noexcept {
+        const int64_t moved = (static_cast<int64_t>(spun) - static_cast<int64_t>(budget)) / 8;
+        spin_budget_.store(static_cast<uint32_t>(static_cast<int64_t>(budget) + moved), std::memory_order_relaxed);
+      }
+
+      void park_() noexcept {
+        //whoever holds it now sees contended_ on unlock and wakes one of us
+        Parking_spot& spot = parking_spot(this);
+        while (state_.exchange(contended_, std::memory_order_acquire) != unlocked_) {
+          std::unique_lock lock{ spot.mutex };
+          spot.parked.wait(lock, [this]() { return state_.load(std::memory_order_relaxed) != contended_; });
+        }
+      }
+
+      std::atomic<uint32_t> state_{ unlocked_ };
+      std::atomic<uint32_t> spin_budget_{ 0 };
+    };
+
+    /*
+    A reader-writer lock where readers only touch their own cache line:
+    each thread counts itself in one of a fixed set of slots, so readers on
+    different cores don't fight over a shared count the way they do in
+    std::shared_mutex. Writers announce themselves, then wait for every
+    slot to drain, which makes them dearer, so this is for read mostly data.
+    */
+    class Sharded_shared_mutex {
+    public:
+      static constexpr size_t slot_count = 16;
+
+      Sharded_shared_mutex() = default;
+      Sharded_shared_mutex(Sharded_shared_mutex const&) = delete;
+      Sharded_shared_mutex& operator=(Sharded_shared_mutex const&) = delete;
+
+      void lock_shared() noexcept {
+        std::atomic<uint32_t>& readers = slots_[slot_()].readers;
+        for (;;) {
+          //seq_cst on both sides: either the writer sees our count, or we see its flag
+          readers.fetch_add(1, std::memory_order_seq_cst);
+          if (!writing_.load(std::memory_order_seq_cst)) {
+            return;
+          }
+          readers.fetch_sub(1, std::memory_order_release);
+          spin_until_([this]() { return !writing_.load(std::memory_order_acquire); });
+        }
+      }
+
+      bool try_lock_shared() noexcept {
+        std::atomic<uint32_t>& readers = slots_[slot_()].readers;
+        readers.fetch_add(1, std::memory_order_seq_cst);
+        if (!writing_.load(std::memory_order_seq_cst)) {
+          return true;
+        }
+        readers.fetch_sub(1, std::memory_order_release);
+        return false;
+      }
+
+      void unlock_shared() noexcept {
+        slots_[slot_()].readers.fetch_sub(1, std::memory_order_release);
+      }
+
+      void lock() noexcept {
+        writers_.lock();
+        writing_.store(true, std::memory_order_seq_cst);
+        for (Slot& slot : slots_) {
+          spin_until_([&slot]() { return slot.readers.load(std::memory_order_seq_cst) == 0; });
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+      }
+
+      bool try_lock() noexcept {
+        if (!writers_.try_lock()) {
+          return false;
+        }
+        writing_.store(true, std::memory_order_seq_cst);
+        for (Slot& slot : slots_) {
+          if (slot.readers.load(std::memory_order_seq_cst) != 0) {
+            writing_.store(false, std::memory_order_release);
+            writers_.unlock();
+            return false;
+          }
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return true;
+      }
+
+      void unlock() noexcept {
+        writing_.store(false, std::memory_order_release);
+        writers_.unlock();
+      }
+    private:
+      struct alignas(cache_line_size) Slot {
+        std::atomic<uint32_t> readers{ 0 };
+      };
+
+      /*threads take slots round robin, a thread keeps its slot so unlock_shared finds the count it added to*/
+      static size_t slot_() noexcept {
+        static std::atomic<size_t> next{ 0 };
+        thread_local const size_t slot = next.fetch_add(1, std::memory_order_relaxed) % slot_count;
+        return slot;
+      }
+
+      /*both sides only wait out critical sections, so we spin, then yield rather than park*/
+      template<typename Predicate>
+      static void spin_until_(Predicate&& done) noexcept {
+        for (uint32_t spun = 0; !done(); ++spun) {
+          if (spun < 64) {
+            cpu_relax();
+          } else {
+            std::this_thread::yield();
+          }
+        }
+      }
+
+      Slot slots_[slot_count];
+      alignas(cache_line_size) std::atomic<bool> writing_{ false };
+      Spin_mutex writers_;
+    };
+  }
+
+  /*Std_concurrency, but locks spin before parking and readers don't share a count*/
+  struct Spin_concurrency : Std_concurrency {
+    using Mutex = impl::Spin_mutex;
+    using Shared_mutex = impl::Sharded_shared_mutex;
+    using Condition_variable = std::condition_variable_any;
+  };
+
   struct Null_concurrency {
     using Mutex = impl::Null_mutex;
+    using Shared_mutex = impl::Null_mutex;
+    using Condition_variable = impl::Null_condition_variable;
+    using Condition_variable_any = impl::Null_condition_variable;
 
     template<typename T>
     using Atomic = T;
@@ -83,6 +424,31 @@ namespace dlib {
       *p = v;
     }
 
+    /*there are no other threads, so f runs right away*/
+    template<typename F>
+    static void spawn(F&& f) {
+      std::forward<F>(f)();
+    }
+
+    /*everything spawned has already run by the time spawn returns*/
+    struct Task_group {};
+
+    template<typename F>
+    static void spawn(Task_group&, F&& f) {
+      std::forward<F>(f)();
+    }
+
+    static void wait(Task_group&) noexcept {
+
+    }
+
+    template<typename Index, typename F>
+    static void parallel_for(Index begin, Index end, F&& f) {
+      for (Index i = begin; i < end; ++i) {
+        f(i);
+      }
+    }
+
     template<typename T,typename>
     struct Thread_local {
       T t;
@@ -98,8 +98,9 @@ namespace dlib {
       }
     }
 
-    template<typename ...Columns, typename Driver, typename ...Args, typename Callback>
-    Result<void> execute_(Driver& driver, std::string_view sql, Callback&& callback, Args const&... args) noexcept {
+    /*sql is whatever the driver's execute takes, the query text or one of its prepared statements*/
+    template<typename ...Columns, typename Driver, typename Sql, typename ...Args, typename Callback>
+    Result<void> execute_(Driver& driver, Sql&& sql, Callback&& callback, Args const&... args) noexcept {
       using Tuple = std::tuple<Columns...>;
       Tuple columns;
       auto cb = [&columns, &callback](auto& results) noexcept -> Result<void> {
@@ -113,7 +114,7 @@ namespace dlib {
         return success;
       };
 
-      return execute(driver, sql, cb, args...);
+      return execute(driver, std::forward<Sql>(sql), cb, args...);
     }
 
     struct Closed {
@@ -192,6 +193,7 @@ namespace dlib {
       close();
       state_ = std::move(other.state_);
       other.state_ = db_impl::closed;
+      return *this;
     }
     ~Db() {
       close();
@@ -277,7 +279,7 @@ namespace dlib {
     Result<const Driver*> driver() const noexcept {
       const Driver* driver = std::get_if<Driver>(&state_);
       if (driver == nullptr) {
-        return Errors::wrong_state;
+        return error("db is not open");
       }
       return driver;
     }
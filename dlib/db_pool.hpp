@@ -0,0 +1,284 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <algorithm>
+#include <optional>
+#include <unordered_map>
+#include <type_traits>
+#include <utility>
+
+#include <dlib/args.hpp>
+#include <dlib/concurrency.hpp>
+#include <dlib/db.hpp>
+#include <dlib/outcome.hpp>
+#include <dlib/pool.hpp>
+
+/*
+A pool of open connections to one database, on top of Versioned_pool.
+
+get() hands out a Checkout, which gives its connection back when it goes
+(it's the pool's Returning_pointer, noting when the connection went idle).
+After a failover invalidate() bumps the version, so every connection out
+at the time is closed when it comes back, and idle ones are closed there
+and then.
+
+A connection that sat idle for longer than check_after is health checked
+before being handed out, with driver.ping() if the driver has one and the
+health query otherwise. Connections failing it are closed and we try the
+next. reap_idle() closes connections idle longer than max_idle.
+
+If the driver has prepare(sql) (and an execute taking what it returns),
+each connection keeps the statements it prepared, keyed on their text,
+and executing the same query again reuses them.
+*/
+
+namespace dlib {
+  struct Db_pool_options {
+    Pool_limits limits;
+    //connections idle for at least this long are checked before going out
+    std::chrono::milliseconds check_after{ std::chrono::seconds{ 1 } };
+    //reap_idle closes connections idle for at least this long
+    std::chrono::milliseconds max_idle{ std::chrono::minutes{ 5 } };
+    //what we run to check a connection when the driver has no ping
+    std::string health_query = "SELECT 1;";
+  };
+
+  namespace db_pool_impl {
+    template<typename Driver, typename = void>
+    constexpr bool has_ping = false;
+
+    template<typename Driver>
+    constexpr bool has_ping<Driver, std::void_t<decltype(std::declval<Driver&>().ping())>> = true;
+
+    template<typename Driver, typename = void>
+    constexpr bool has_prepare = false;
+
+    template<typename Driver>
+    constexpr bool has_prepare<Driver, std::void_t<decltype(std::declval<Driver&>().prepare(std::declval<std::string_view>()))>> = true;
+
+    template<typename Driver, bool = has_prepare<Driver>>
+    struct Prepared_of {
+      struct Nothing {};
+      using Type = Nothing;
+    };
+
+    template<typename Driver>
+    struct Prepared_of<Driver, true> {
+      using Type = std::decay_t<decltype(std::declval<Driver&>().prepare(std::declval<std::string_view>()).value())>;
+    };
+
+    template<typename Driver_, typename Clock_>
+    class Connection {
+    public:
+      using Driver = Driver_;
+      using Clock_arg = Clock_;
+      using Time = typename Clock_arg::time_point;
+      using Prepared = typename Prepared_of<Driver>::Type;
+
+      static constexpr bool prepares = has_prepare<Driver>;
+
+      Db<Driver>& db() noexcept {
+        return db_;
+      }
+
+      template<typename ...Columns, typename ...Args, typename Callback>
+      Result<void> execute(std::string_view query, Callback&& callback, Args const& ... args) noexcept {
+        if constexpr (prepares) {
+          DLIB_TRY(driver, (db_.driver()));
+          DLIB_TRY(prepared, (prepared_(*driver, query)));
+          return db_impl::execute_<Columns...>(*driver, *prepared, std::forward<Callback>(callback), args...);
+        } else {
+          return db_.template execute<Columns...>(query, std::forward<Callback>(callback), args...);
+        }
+      }
+
+      template<typename Callback>
+      Result<void> transaction(Callback&& cb) noexcept {
+        return db_.transaction(std::forward<Callback>(cb));
+      }
+
+      /*how many statements we're holding on to*/
+      size_t prepared() const noexcept {
+        return statements_.size();
+      }
+
+      /*when we were last given back, or opened if we've never been out*/
+      std::optional<Time> idle_since() const noexcept {
+        return idle_since_;
+      }
+
+      static Result<Connection> open(std::string_view location) noexcept {
+        Connection connection;
+        DLIB_TRY((connection.db_.open(location)));
+        //idle from the start, so ones pre-warmed and left alone still get checked and reaped
+        connection.idle_since_ = Clock_arg::now();
+        return connection;
+      }
+    private:
+      template<typename, typename, typename>
+      friend class Db_pool;
+
+      Connection() = default;
+
+      Result<Prepared*> prepared_(Driver& driver, std::string_view query) noexcept {
+        //string keys, C++17 maps can't look up by string_view
+        std::string key{ query };
+        auto found = statements_.find(key);
+        if (found == statements_.end()) {
+          DLIB_TRY(prepared, (driver.prepare(query)));
+          found = statements_.emplace(std::move(key), std::move(prepared)).first;
+        }
+        return &found->second;
+      }
+
+      Db<Driver> db_;
+      //declared after db_, so statements are gone before the connection closes
+      std::unordered_map<std::string, Prepared> statements_;
+      std::optional<Time> idle_since_;
+    };
+
+    template<typename Driver_, typename Concurrency_, typename Clock_>
+    class Db_pool {
+    public:
+      using Driver = Driver_;
+      using Concurrency_arg = Concurrency_;
+      using Clock_arg = Clock_;
+      using Connection = db_pool_impl::Connection<Driver, Clock_arg>;
+      using Pool = pool_impl::Versioned_pool<Connection, Concurrency_arg, Raw_pointer>;
+      using Version = typename Pool::Version;
+
+      /*A connection we handed out, it goes back to the pool when this goes*/
+      class Checkout {
+      public:
+        Checkout(Checkout const&) = delete;
+        Checkout(Checkout&&) noexcept = default;
+        Checkout& operator=(Checkout const&) = delete;
+        Checkout& operator=(Checkout&& other) noexcept {
+          mark_idle_();
+          connection_ = std::move(other.connection_);
+          return *this;
+        }
+        ~Checkout() noexcept {
+          mark_idle_();
+        }
+
+        Connection& operator*() noexcept {
+          return *connection_;
+        }
+        Connection* operator->() noexcept {
+          return connection_.operator->();
+        }
+      private:
+        friend class Db_pool;
+
+        explicit Checkout(typename Pool::Pointer connection) noexcept :
+          connection_{ std::move(connection) } {
+
+        }
+
+        /*the pointer gives it back, we just note when*/
+        void mark_idle_() noexcept {
+          if (connection_) {
+            connection_->idle_since_ = Clock_arg::now();
+          }
+        }
+
+        typename Pool::Pointer connection_;
+      };
+
+      explicit Db_pool(std::string location, Db_pool_options options = Db_pool_options{}) :
+        location_{ std::move(location) },
+        options_{ std::move(options) },
+        pool_{ options_.limits, [this]() { return Connection::open(location_); } } {
+
+      }
+      Db_pool(Db_pool const&) = delete;
+      Db_pool& operator=(Db_pool const&) = delete;
+
+      /*an idle connection that passes its health check, or a new one*/
+      Result<Checkout> get() noexcept {
+        for (;;) {
+          DLIB_TRY(connection, (pool_.get([this]() { return Connection::open(location_); })));
+          if (check_(connection)) {
+            return Checkout{ std::move(connection) };
+          }
+        }
+      }
+
+      /*get, waiting up to timeout for a connection to come back if we're at our max*/
+      template<typename Rep, typename Period>
+      Result<Checkout> get_for(std::chrono::duration<Rep, Period> timeout) noexcept {
+        const auto until = std::chrono::steady_clock::now() + timeout;
+        for (;;) {
+          const auto left = std::max(until - std::chrono::steady_clock::now(), std::chrono::steady_clock::duration::zero());
+          DLIB_TRY(connection, (pool_.get_for([this]() { return Connection::open(location_); }, left)));
+          if (check_(connection)) {
+            return Checkout{ std::move(connection) };
+          }
+        }
+      }
+
+      /*after a failover, every connection we have or handed out is closed rather than reused*/
+      void invalidate() noexcept {
+        pool_.increment_version();
+      }
+
+      /*closes connections idle for at least max_idle, keeping limits.min, returns how many closed*/
+      size_t reap_idle() {
+        const auto now = Clock_arg::now();
+        return pool_.drop_idle_if([this, now](Connection const& connection) {
+          return connection.idle_since_ && now - *connection.idle_since_ >= options_.max_idle;
+        }, options_.limits.min);
+      }
+
+      Version version() const noexcept {
+        return pool_.version();
+      }
+
+      size_t idle() const noexcept {
+        return pool_.idle();
+      }
+
+      size_t in_use() const noexcept {
+        return pool_.in_use();
+      }
+
+      Db_pool_options const& options() const noexcept {
+        return options_;
+      }
+    private:
+      /*false if the connection failed its check, it's closed and connection left empty*/
+      bool check_(typename Pool::Pointer& connection) noexcept {
+        //ones opened or back recently enough aren't worth a round trip
+        if (!connection->idle_since_ || Clock_arg::now() - *connection->idle_since_ < options_.check_after) {
+          return true;
+        }
+        if (healthy_(*connection)) {
+          return true;
+        }
+        pool_.discard(std::move(*connection.release()));
+        return false;
+      }
+
+      bool healthy_(Connection& connection) noexcept {
+        if constexpr (has_ping<Driver>) {
+          auto driver = connection.db_.driver();
+          return driver && !!driver.value()->ping();
+        } else {
+          return !!connection.db_.execute(options_.health_query, []() {});
+        }
+      }
+
+      std::string location_;
+      Db_pool_options options_;
+      Pool pool_;
+    };
+  }
+
+  template<typename Driver, typename ...Args>
+  using Db_pool = db_pool_impl::Db_pool<Driver,
+    First<Get_arg_defaulted<Concurrency_is, List<Std_concurrency>, Args...>>,
+    First<Get_arg_defaulted<Clock_is, List<std::chrono::steady_clock>, Args...>>>;
+}
@@ -0,0 +1,486 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <limits>
+#include <functional>
+#include <algorithm>
+
+#include <dlib/concurrency.hpp>
+
+/*
+Eviction policies for capacity bounded containers (see Cache).
+
+A policy is a type with a nested template:
+
+  template<typename Key, typename Concurrency>
+  class Type {
+    using Hook = ...;                           //lives inside the container's node for every key
+    static constexpr bool bounded;              //false if the container can skip evicting entirely
+    static constexpr bool concurrent_touch;     //true if touched can run on many threads at once (under a shared lock)
+
+    explicit Type(size_t capacity);
+    void inserted(Key const& key, Hook& hook);  //key was just added, hook is its node's hook
+    void touched(Hook& hook);                   //key was hit
+    void erased(Hook& hook);                    //key is about to be removed from the container
+    void clear();                               //every key is about to be removed
+    const Key* victim();                        //which key should go next, the container then erases it
+  };
+
+Hooks are stored by the container and must stay at the same address while
+linked (node based maps guarantee this). Copying a hook gives an unlinked
+hook, containers re-insert everything after a copy.
+*/
+
+namespace dlib {
+  template<typename>
+  struct Eviction_is;
+
+  namespace eviction_impl {
+    /*intrusive circular doubly linked list node*/
+    template<typename Key>
+    struct List_hook {
+      List_hook() = default;
+      List_hook(List_hook const&) noexcept {
+
+      }
+      List_hook& operator=(List_hook const&) noexcept {
+        return *this;
+      }
+
+      const Key* key = nullptr;
+      List_hook* prev = nullptr;
+      List_hook* next = nullptr;
+    };
+
+    /*intrusive list of hooks, front is most recent*/
+    template<typename Key, typename Hook = List_hook<Key>>
+    class Hook_list {
+    public:
+      Hook_list() noexcept {
+        sentinel_.prev = &sentinel_;
+        sentinel_.next = &sentinel_;
+      }
+      Hook_list(Hook_list const&) = delete;
+      Hook_list& operator=(Hook_list const&) = delete;
+
+      bool empty() const noexcept {
+        return size_ == 0;
+      }
+
+      size_t size() const noexcept {
+        return size_;
+      }
+
+      Hook* front() noexcept {
+        return empty() ? nullptr : static_cast<Hook*>(sentinel_.next);
+      }
+
+      Hook* back() noexcept {
+        return empty() ? nullptr : static_cast<Hook*>(sentinel_.prev);
+      }
+
+      /*the hook after this one, wrapping around past the back*/
+      Hook* after(Hook* hook) noexcept {
+        List_hook<Key>* next = hook->next == &sentinel_ ? sentinel_.next : hook->next;
+        return static_cast<Hook*>(next);
+      }
+
+      void push_front(Hook& hook) noexcept {
+        link_(hook, sentinel_.next);
+      }
+
+      void push_back(Hook& hook) noexcept {
+        link_(hook, &sentinel_);
+      }
+
+      /*links hook so it ends up right before before*/
+      void insert_before(Hook& hook, Hook* before) noexcept {
+        link_(hook, before);
+      }
+
+      void remove(Hook& hook) noexcept {
+        hook.prev->next = hook.next;
+        hook.next->prev = hook.prev;
+        hook.prev = nullptr;
+        hook.next = nullptr;
+        --size_;
+      }
+
+      void move_to_front(Hook& hook) noexcept {
+        remove(hook);
+        push_front(hook);
+      }
+
+      void clear() noexcept {
+        sentinel_.prev = &sentinel_;
+        sentinel_.next = &sentinel_;
+        size_ = 0;
+      }
+    private:
+      void link_(Hook& hook, List_hook<Key>* before) noexcept {
+        hook.next = before;
+        hook.prev = before->prev;
+        before->prev->next = &hook;
+        before->prev = &hook;
+        ++size_;
+      }
+
+      List_hook<Key> sentinel_;
+      size_t size_ = 0;
+    };
+
+    constexpr size_t next_power_of_two(size_t n) noexcept {
+      size_t power = 1;
+      while (power < n) {
+        power <<= 1;
+      }
+      return power;
+    }
+
+    /*
+    Count-min sketch of 4 bit counters (stored a byte each), 4 rows.
+    Every counter is halved once sample_size increments have happened,
+    so old popularity fades out.
+    */
+    template<typename Key>
+    class Frequency_sketch {
+    public:
+      explicit Frequency_sketch(size_t capacity) noexcept :
+        width_{ next_power_of_two(std::clamp<size_t>(capacity, 16, size_t{ 1 } << 20)) },
+        counters_(width_ * rows_, 0),
+        sample_size_{ width_ * 10 },
+        additions_{ 0 } {
+
+      }
+
+      uint8_t frequency(Key const& key) const noexcept {
+        const uint64_t hash = std::hash<Key>{}(key);
+        uint8_t min = max_count_;
+        for (size_t row = 0; row < rows_; ++row) {
+          min = std::min(min, counters_[index_(hash, row)]);
+        }
+        return min;
+      }
+
+      void increment(Key const& key) noexcept {
+        const uint64_t hash = std::hash<Key>{}(key);
+        bool added = false;
+        for (size_t row = 0; row < rows_; ++row) {
+          uint8_t& counter = counters_[index_(hash, row)];
+          if (counter < max_count_) {
+            ++counter;
+            added = true;
+          }
+        }
+        if (added && ++additions_ >= sample_size_) {
+          age_();
+        }
+      }
+    private:
+      static constexpr size_t rows_ = 4;
+      static constexpr uint8_t max_count_ = 15;
+
+      size_t index_(uint64_t hash, size_t row) const noexcept {
+        //a different odd multiplier per row gives us rows_ roughly independent hashes
+        constexpr uint64_t seeds[rows_] = {
+          0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL };
+        const uint64_t mixed = (hash + row) * seeds[row];
+        return row * width_ + static_cast<size_t>((mixed >> 32) & (width_ - 1));
+      }
+
+      void age_() noexcept {
+        for (uint8_t& counter : counters_) {
+          counter >>= 1;
+        }
+        additions_ /= 2;
+      }
+
+      size_t width_;
+      std::vector<uint8_t> counters_;
+      size_t sample_size_;
+      size_t additions_;
+    };
+  }
+
+  /*Never evicts, the container grows without bound*/
+  struct No_eviction {
+    template<typename Key, typename Concurrency>
+    class Type {
+    public:
+      struct Hook {};
+      static constexpr bool bounded = false;
+      static constexpr bool concurrent_touch = true;
+
+      explicit Type(size_t) noexcept {
+
+      }
+
+      void inserted(Key const&, Hook&) noexcept {
+
+      }
+
+      void touched(Hook&) noexcept {
+
+      }
+
+      void erased(Hook&) noexcept {
+
+      }
+
+      void clear() noexcept {
+
+      }
+
+      const Key* victim() noexcept {
+        return nullptr;
+      }
+    };
+  };
+
+  /*Least recently used goes first*/
+  struct Lru_eviction {
+    template<typename Key, typename Concurrency>
+    class Type {
+    public:
+      using Hook = eviction_impl::List_hook<Key>;
+      static constexpr bool bounded = true;
+      //a hit relinks the list
+      static constexpr bool concurrent_touch = false;
+
+      explicit Type(size_t) noexcept {
+
+      }
+
+      void inserted(Key const& key, Hook& hook) noexcept {
+        hook.key = &key;
+        order_.push_front(hook);
+      }
+
+      void touched(Hook& hook) noexcept {
+        order_.move_to_front(hook);
+      }
+
+      void erased(Hook& hook) noexcept {
+        order_.remove(hook);
+      }
+
+      void clear() noexcept {
+        order_.clear();
+      }
+
+      const Key* victim() noexcept {
+        Hook* last = order_.back();
+        return last == nullptr ? nullptr : last->key;
+      }
+    private:
+      eviction_impl::Hook_list<Key> order_;
+    };
+  };
+
+  /*
+  Second chance: keys sit on a ring, a hit only sets a flag. The hand
+  sweeps the ring clearing flags and evicts the first key without one.
+  */
+  struct Clock_eviction {
+    template<typename Key, typename Concurrency>
+    class Type {
+    public:
+      struct Hook :
+        public eviction_impl::List_hook<Key> {
+        Hook() noexcept :
+          referenced{ false } {
+
+        }
+        Hook(Hook const&) noexcept :
+          eviction_impl::List_hook<Key>{},
+          referenced{ false } {
+
+        }
+        Hook& operator=(Hook const&) noexcept {
+          return *this;
+        }
+
+        Atomic<Concurrency, bool> referenced;
+      };
+      static constexpr bool bounded = true;
+      //a hit only sets its own atomic flag
+      static constexpr bool concurrent_touch = true;
+
+      explicit Type(size_t) noexcept :
+        hand_{ nullptr } {
+
+      }
+
+      void inserted(Key const& key, Hook& hook) noexcept {
+        hook.key = &key;
+        //new keys go right behind the hand, so they get a full sweep before being looked at
+        if (hand_ == nullptr) {
+          ring_.push_back(hook);
+          hand_ = &hook;
+        } else {
+          ring_.insert_before(hook, hand_);
+        }
+      }
+
+      void touched(Hook& hook) noexcept {
+        hook.referenced = true;
+      }
+
+      void erased(Hook& hook) noexcept {
+        if (hand_ == &hook) {
+          hand_ = ring_.size() == 1 ? nullptr : ring_.after(&hook);
+        }
+        ring_.remove(hook);
+      }
+
+      void clear() noexcept {
+        ring_.clear();
+        hand_ = nullptr;
+      }
+
+      const Key* victim() noexcept {
+        if (hand_ == nullptr) {
+          return nullptr;
+        }
+        //bounded, after one lap every flag is clear
+        while (hand_->referenced) {
+          hand_->referenced = false;
+          hand_ = ring_.after(hand_);
+        }
+        return hand_->key;
+      }
+    private:
+      eviction_impl::Hook_list<Key, Hook> ring_;
+      Hook* hand_;
+    };
+  };
+
+  /*
+  W-TinyLFU: new keys land in a small LRU window. Keys leaving the window
+  have to beat the main area's victim on estimated frequency to be kept,
+  the main area being a segmented LRU (probation + protected). This keeps
+  one-hit wonders and scans from flushing out the popular keys.
+  */
+  struct Tiny_lfu_eviction {
+    template<typename Key, typename Concurrency>
+    class Type {
+    public:
+      enum class Segment : uint8_t {
+        Window,
+        Probation,
+        Protected
+      };
+
+      struct Hook :
+        public eviction_impl::List_hook<Key> {
+        Segment segment = Segment::Window;
+      };
+      static constexpr bool bounded = true;
+      static constexpr bool concurrent_touch = false;
+
+      explicit Type(size_t capacity) noexcept :
+        sketch_{ capacity },
+        window_max_{ std::max<size_t>(1, capacity / 100) },
+        protected_max_{ (capacity - std::min(capacity, window_max_)) / 5 * 4 } {
+
+      }
+
+      void inserted(Key const& key, Hook& hook) noexcept {
+        hook.key = &key;
+        hook.segment = Segment::Window;
+        sketch_.increment(key);
+        window_.push_front(hook);
+      }
+
+      void touched(Hook& hook) noexcept {
+        sketch_.increment(*hook.key);
+        switch (hook.segment) {
+        case Segment::Window:
+          window_.move_to_front(hook);
+          break;
+        case Segment::Probation:
+          probation_.remove(hook);
+          hook.segment = Segment::Protected;
+          protected_.push_front(hook);
+          demote_protected_();
+          break;
+        case Segment::Protected:
+          protected_.move_to_front(hook);
+          break;
+        }
+      }
+
+      void erased(Hook& hook) noexcept {
+        list_(hook.segment).remove(hook);
+      }
+
+      void clear() noexcept {
+        window_.clear();
+        probation_.clear();
+        protected_.clear();
+      }
+
+      const Key* victim() noexcept {
+        //overflow from the window becomes a candidate for the main area
+        Hook* candidate = nullptr;
+        while (window_.size() > window_max_) {
+          candidate = window_.back();
+          window_.remove(*candidate);
+          candidate->segment = Segment::Probation;
+          probation_.push_front(*candidate);
+        }
+
+        Hook* victim = probation_.back();
+        if (victim == nullptr) {
+          victim = protected_.back();
+        }
+        if (victim == nullptr) {
+          victim = window_.back();
+        }
+        if (victim == nullptr) {
+          return nullptr;
+        }
+
+        if (candidate == nullptr || candidate == victim) {
+          return victim->key;
+        }
+
+        //admission, whichever has been seen less leaves
+        if (sketch_.frequency(*candidate->key) > sketch_.frequency(*victim->key)) {
+          return victim->key;
+        } else {
+          return candidate->key;
+        }
+      }
+    private:
+      eviction_impl::Hook_list<Key, Hook>& list_(Segment segment) noexcept {
+        switch (segment) {
+        case Segment::Window:
+          return window_;
+        case Segment::Probation:
+          return probation_;
+        default:
+          return protected_;
+        }
+      }
+
+      void demote_protected_() noexcept {
+        while (protected_.size() > protected_max_) {
+          Hook* demoting = protected_.back();
+          protected_.remove(*demoting);
+          demoting->segment = Segment::Probation;
+          probation_.push_front(*demoting);
+        }
+      }
+
+      eviction_impl::Frequency_sketch<Key> sketch_;
+      size_t window_max_;
+      size_t protected_max_;
+      eviction_impl::Hook_list<Key, Hook> window_;
+      eviction_impl::Hook_list<Key, Hook> probation_;
+      eviction_impl::Hook_list<Key, Hook> protected_;
+    };
+  };
+}
\ No newline at end of file
@@ -1,9 +1,12 @@
 #pragma once
 
 #include <dlib/interface.hpp>
+#include <dlib/arrays.hpp>
 #include <unordered_map>
 #include <optional>
 #include <functional>
+#include <vector>
+#include <type_traits>
 
 namespace dlib {
   template<typename Instance>
@@ -22,6 +25,27 @@ namespace dlib {
     }
   };
 
+  namespace finder_interface_impl {
+    template<typename Instance, typename Keys, typename = void>
+    constexpr bool has_get_many = false;
+
+    template<typename Instance, typename Keys>
+    constexpr bool has_get_many<Instance, Keys, std::void_t<decltype(std::declval<Instance*>()->get_many(std::declval<Keys>()))>> = true;
+  }
+
+  /*Uses instance->get_many if it has one, otherwise returns nullopt so the caller falls back to get*/
+  template<typename Instance>
+  struct Finder_default_get_many {
+    template<typename Keys>
+    constexpr auto operator()(Instance* instance, Keys keys) const noexcept {
+      if constexpr (finder_interface_impl::has_get_many<Instance, Keys>) {
+        return std::optional{ instance->get_many(std::move(keys)) };
+      } else {
+        return std::nullopt;
+      }
+    }
+  };
+
   template<typename Key, typename Value, typename Hash, typename Eq, typename Allocator>
   struct Finder_default_get<std::unordered_map<Key, Value, Hash, Eq, Allocator>> {
     using Instance = std::unordered_map<Key, Value, Hash, Eq, Allocator>;
@@ -63,6 +87,39 @@ namespace dlib {
       };
     };
 
+    struct Get_many_tag;
+
+    /*
+    Looks up many keys at once, answers are in the same order as keys.
+    Sources that can batch (one IN (...) query instead of one per key) provide
+    get_many, either as a member or an override, everyone else gets one get per key.
+    */
+    template<typename Key, typename Value>
+    struct Get_many_function {
+      using Batch = std::vector<std::optional<Value>>;
+
+      template<typename Parent_>
+      class Type :
+        public Interface_function<Parent_, false, std::optional<Batch>(*)(Array_view<const Key>), Finder_default_get_many, Get_many_tag> {
+      public:
+        using Interface_function<Parent_, false, std::optional<Batch>(*)(Array_view<const Key>), Finder_default_get_many, Get_many_tag>::Interface_function;
+
+        Batch get_many(Array_view<const Key> keys) noexcept {
+          auto batched = this->call_(keys);
+          if (batched) {
+            return std::move(batched.value());
+          }
+
+          Batch returning;
+          returning.reserve(keys.size());
+          for (Key const& key : keys) {
+            returning.emplace_back(static_cast<Parent_*>(this)->get(key));
+          }
+          return returning;
+        }
+      };
+    };
+
     struct Contains_tag;
 
     template<typename Key>
@@ -90,12 +147,18 @@ namespace dlib {
     return { std::move(val) };
   }
 
+  template<typename T>
+  constexpr Arg<finder_interface_impl::Get_many_tag>::Holder<T> finder_get_many(T val) noexcept {
+    return { std::move(val) };
+  }
+
   template<typename Key, typename Value>
   struct Finder_subinterface {
     template<typename Parent>
     using Type = Subinterface<
       typename finder_interface_impl::Get_function<Key, Value>::template Type<Parent>,
-      typename finder_interface_impl::Contains_function<Key>::template Type<Parent>>;
+      typename finder_interface_impl::Contains_function<Key>::template Type<Parent>,
+      typename finder_interface_impl::Get_many_function<Key, Value>::template Type<Parent>>;
   };
 
   template<typename Key, typename Value>
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <thread>
+
+/*
+Which NUMA node a thread is running on, for containers that keep a
+replica per node (see Numa_pool and Numa_cache).
+
+On Linux nodes come from /sys/devices/system/node, and the calling
+thread's node from the cpu it's on. Anywhere else, or if that can't be
+read, there is one node, node 0, and pinning does nothing.
+*/
+
+namespace dlib {
+  /*how many nodes there are, at least 1*/
+  size_t numa_node_count() noexcept;
+
+  /*the node the calling thread is on right now, less than numa_node_count()*/
+  size_t current_numa_node() noexcept;
+
+  /*keeps the calling thread on node's cpus, false if we couldn't*/
+  bool pin_to_numa_node(size_t node) noexcept;
+
+  /*
+  make() once per node, each on a thread pinned to the node, so whatever
+  it allocates is first touched there. With one node it just runs here.
+  */
+  template<typename T, typename Make>
+  std::vector<std::unique_ptr<T>> make_per_numa_node(Make&& make) {
+    std::vector<std::unique_ptr<T>> made(numa_node_count());
+    if (made.size() == 1) {
+      made[0] = make();
+      return made;
+    }
+    for (size_t node = 0; node < made.size(); ++node) {
+      std::thread{ [&made, &make, node]() {
+        pin_to_numa_node(node);
+        made[node] = make();
+      } }.join();
+    }
+    return made;
+  }
+}
@@ -71,8 +71,9 @@ namespace dlib {
     template<typename T>
     using Pointer_to = std::shared_ptr<T>;
 
+    /*whatever uses this has to be owned by a shared_ptr*/
     class Pointer_from :
-      private std::enable_shared_from_this<Pointer_from> {
+      public std::enable_shared_from_this<Pointer_from> {
     public:
       template<typename T>
       Pointer_to<T> get_pointer_to(T* t) noexcept {
@@ -86,6 +87,11 @@ namespace dlib {
       Holder(T t) :
         holding_(std::make_shared<T>(std::move(t))) {
 
+      }
+      /*a share in something already owned*/
+      explicit Holder(Pointer_to<T> holding) noexcept :
+        holding_(std::move(holding)) {
+
       }
       Holder(Holder const&) = default;
       Holder(Holder&&) = default;
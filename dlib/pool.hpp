@@ -2,30 +2,81 @@
 
 #include <vector>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include <cassert>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <optional>
+#include <type_traits>
+#include <utility>
 #include <dlib/args.hpp>
 #include <dlib/concurrency.hpp>
 #include <dlib/outcome.hpp>
 #include <dlib/pointer_to.hpp>
-#include <dlib/unique_value.hpp>
+#include <dlib/numa.hpp>
 
 namespace dlib {
+  /*How many objects a thread keeps to itself in a Magazine_pool before going to the shared depot*/
+  template<size_t>
+  struct Magazine_size_is {};
+
+  /*
+  Bounds on a pool. min objects are constructed up front when the pool is
+  given a constructor, at most max objects are ever out or idle at once,
+  and objects given back while high_watermark are idle get destroyed.
+  */
+  struct Pool_limits {
+    static constexpr size_t unlimited = std::numeric_limits<size_t>::max();
+
+    size_t min = 0;
+    size_t max = unlimited;
+    size_t high_watermark = unlimited;
+  };
+
+  /*
+  What a pool did with the objects asked of it and given back to it.
+  A falling recycle rate or a growing leaked count means objects are
+  going to the allocator instead of back to us.
+  */
+  struct Pool_stats {
+    //gets served from an idle object
+    uint64_t recycled;
+    //gets that had to construct a new object
+    uint64_t constructed;
+    //objects given back and kept
+    uint64_t returned;
+    //objects given back but destroyed, past the high watermark, stale or discarded
+    uint64_t dropped;
+    //objects handed out that were destroyed without being given back
+    uint64_t leaked;
+
+    double recycle_rate() const noexcept {
+      const uint64_t gets = recycled + constructed;
+      return gets == 0 ? 0.0 : static_cast<double>(recycled) / static_cast<double>(gets);
+    }
+  };
 
   template<typename Pool>
   class Return_to_pool_destroyer {
   public:
-    using Pool_holder = typename Pool::Holder;
-    using Pool_type = typename Pool::Type;
+    using Pool_pointer = typename Pool::Pointer_to;
+    //a share in the pool, so it lives as long as what's out of it. a raw pointer's Holder would be a copy of the pool, so that just points
+    using Pool_holder = std::conditional_t<std::is_same_v<typename Pool::Pointer_arg, Raw_pointer>, Pool_pointer, typename Pool::Holder>;
+    using Pooled = typename Pool::Pooled;
 
-    Return_to_pool_destroyer(Pool_holder pool) :
+    Return_to_pool_destroyer(Pool_pointer pool) noexcept :
       pool_(std::move(pool)) {
 
     }
 
-    void operator()(Pool_type& type) const noexcept {
-      pool_->give_back(std::move(type));
+    void operator()(Pooled&& pooled) const noexcept {
+      pool_->give_back(std::move(pooled));
     }
   private:
-    Pool_holder pool_;
+    mutable Pool_holder pool_;
   };
 
   template<typename Pool_>
@@ -41,10 +92,130 @@ namespace dlib {
       value(std::move(value_)) {
 
     }
+
+    /*owed back to pool, which counts it as leaked if it's destroyed before then*/
+    Pooled(Type value_, Info info, Pool* owed_to) :
+      Info(info),
+      value(std::move(value_)),
+      owed_to_{ owed_to } {
+
+    }
+
+    Pooled(Pooled&& other) noexcept :
+      Info(static_cast<Info const&>(other)),
+      value(std::move(other.value)),
+      owed_to_{ std::exchange(other.owed_to_, nullptr) } {
+
+    }
+    Pooled& operator=(Pooled&& other) noexcept {
+      leak_();
+      static_cast<Info&>(*this) = static_cast<Info const&>(other);
+      value = std::move(other.value);
+      owed_to_ = std::exchange(other.owed_to_, nullptr);
+      return *this;
+    }
+    ~Pooled() noexcept {
+      leak_();
+    }
+
+    /*the pool has it back, or knows it isn't coming back*/
+    void settle() noexcept {
+      owed_to_ = nullptr;
+    }
+
+    /*the pool it should go back to, null if it isn't being tracked*/
+    Pool* owed_to() const noexcept {
+      return owed_to_;
+    }
+  private:
+    void leak_() noexcept {
+      if (owed_to_ != nullptr) {
+        owed_to_->note_leaked_();
+      }
+    }
+
+    Pool* owed_to_ = nullptr;
   };
 
+  /*
+  An object out of a pool, given back when this goes. Moved from pointers
+  are empty. With Raw_pointer the pool has to outlive it, with
+  Shared_pointer it keeps the pool alive.
+  */
   template<typename Pool_>
-  using Returning_pointer = Unique_value<Pooled<Pool_>, Return_to_pool_destroyer<Pool_>>;
+  class Returning_pointer {
+  public:
+    using Pool = Pool_;
+    using Type = typename Pool::Type;
+    using Pooled = typename Pool::Pooled;
+    using Destroyer = Return_to_pool_destroyer<Pool>;
+
+    Returning_pointer(Pooled pooled, Destroyer destroyer) noexcept :
+      pooled_{ std::move(pooled) },
+      destroyer_{ std::move(destroyer) } {
+
+    }
+    Returning_pointer(Returning_pointer const&) = delete;
+    Returning_pointer(Returning_pointer&& other) noexcept :
+      pooled_{ std::move(other.pooled_) },
+      destroyer_{ other.destroyer_ } {
+      other.pooled_.reset();
+    }
+    Returning_pointer& operator=(Returning_pointer const&) = delete;
+    Returning_pointer& operator=(Returning_pointer&& other) noexcept {
+      reset();
+      pooled_ = std::move(other.pooled_);
+      other.pooled_.reset();
+      destroyer_ = other.destroyer_;
+      return *this;
+    }
+    ~Returning_pointer() noexcept {
+      reset();
+    }
+
+    /*gives the object back now, leaving us empty*/
+    void reset() noexcept {
+      if (pooled_) {
+        destroyer_(std::move(*pooled_));
+        pooled_.reset();
+      }
+    }
+
+    /*takes the object off our hands, it should go to the pool's give_back or discard. Empty if we are*/
+    std::optional<Pooled> release() noexcept {
+      std::optional<Pooled> releasing = std::move(pooled_);
+      pooled_.reset();
+      return releasing;
+    }
+
+    explicit operator bool() const noexcept {
+      return pooled_.has_value();
+    }
+
+    Type& operator*() noexcept {
+      return pooled_->value;
+    }
+    Type const& operator*() const noexcept {
+      return pooled_->value;
+    }
+
+    Type* operator->() noexcept {
+      return &pooled_->value;
+    }
+    const Type* operator->() const noexcept {
+      return &pooled_->value;
+    }
+
+    Type& get() noexcept {
+      return pooled_->value;
+    }
+    Type const& get() const noexcept {
+      return pooled_->value;
+    }
+  private:
+    std::optional<Pooled> pooled_;
+    Destroyer destroyer_;
+  };
 
   namespace pool_impl {
     template<typename Type_, typename Concurrency_, typename Pointer_>
@@ -56,7 +227,62 @@ namespace dlib {
       using Concurrency_arg = Concurrency_;
       using Pointer_arg = Pointer_;
       struct Pooled_info {};
+
+      /*objects sitting in the pool*/
+      size_t idle() const noexcept {
+        auto lock = get_lock_();
+        return holding_.size();
+      }
+
+      /*objects we handed out that haven't come back yet*/
+      size_t in_use() const noexcept {
+        auto lock = get_lock_();
+        return out_;
+      }
+
+      Pool_limits limits() const noexcept {
+        return limits_;
+      }
+
+      Pool_stats stats() const noexcept {
+        auto lock = get_lock_();
+        return stats_;
+      }
+
+      /*destroys the idle objects predicate picks, leaving at least keep idle, returns how many went*/
+      template<typename Predicate>
+      size_t drop_idle_if(Predicate&& predicate, size_t keep = 0) {
+        std::vector<Type_> dropping;
+        {
+          auto lock = get_lock_();
+          dropping = locked_drop_idle_if_(std::forward<Predicate>(predicate), keep);
+        }
+        //destroyed out of the lock
+        return dropping.size();
+      }
     protected:
+      Pool_base() = default;
+
+      explicit Pool_base(Pool_limits limits) :
+        limits_{ limits } {
+
+      }
+
+      /*pre-warms us with limits.min objects from constructor*/
+      template<typename Constructor>
+      Pool_base(Pool_limits limits, Constructor&& constructor) :
+        limits_{ limits } {
+        const size_t warming = std::min(limits_.min, limits_.max);
+        holding_.reserve(warming);
+        for (size_t i = 0; i < warming; ++i) {
+          Result<Type> made{ constructor() };
+          if (!made) {
+            break;
+          }
+          holding_.emplace_back(std::move(made.value()));
+        }
+      }
+
       Result<Type> get_() noexcept {
         auto lock = get_lock_();
         return locked_get_();
@@ -64,15 +290,27 @@ namespace dlib {
 
       template<typename Constructor>
       Result<Type> get_(Constructor&& constructor) {
-        {
-          auto lock = get_lock_();
-          auto got = locked_get_();
-          if (got) {
-            return got;
-          }
+        auto lock = get_lock_();
+        return locked_get_(lock, std::forward<Constructor>(constructor));
+      }
+
+      /*like get_, but if we're at our max, waits up to timeout for someone to give one back*/
+      template<typename Rep, typename Period>
+      Result<Type> get_for_(std::chrono::duration<Rep, Period> timeout) noexcept {
+        auto lock = get_lock_();
+        if (!returned_.wait_for(lock, timeout, [this]() { return !holding_.empty(); })) {
+          return error("timed out waiting for an object");
         }
-        //we call constructor out of the lock
-        return constructor();
+        return locked_get_();
+      }
+
+      template<typename Constructor, typename Rep, typename Period>
+      Result<Type> get_for_(Constructor&& constructor, std::chrono::duration<Rep, Period> timeout) {
+        auto lock = get_lock_();
+        if (!returned_.wait_for(lock, timeout, [this]() { return !holding_.empty() || can_construct_(); })) {
+          return error("timed out waiting for an object");
+        }
+        return locked_get_(lock, std::forward<Constructor>(constructor));
       }
 
       Result<Type> locked_get_() noexcept {
@@ -81,26 +319,143 @@ namespace dlib {
         } else {
           Type value = std::move(holding_.back());
           holding_.pop_back();
+          ++out_;
+          ++stats_.recycled;
           return value;
         }
       }
 
+      /*an idle object that leaves for good, so it isn't counted as out*/
+      Result<Type> take_() noexcept {
+        auto lock = get_lock_();
+        if (holding_.empty()) {
+          return error("backing vector is empty, out of objects");
+        }
+        Type value = std::move(holding_.back());
+        holding_.pop_back();
+        ++stats_.recycled;
+        return value;
+      }
+
+      template<typename Lock, typename Constructor>
+      Result<Type> locked_get_(Lock& lock, Constructor&& constructor) {
+        auto got = locked_get_();
+        if (got) {
+          return got;
+        }
+        if (!can_construct_()) {
+          return error("pool is at its max");
+        }
+        //counted as out while we construct, so nobody else goes over max meanwhile
+        ++out_;
+        ++stats_.constructed;
+        //taken back unless constructor gives us something, whether it errors or throws
+        struct Unclaim {
+          Pool_base* pool;
+          Lock& lock;
+          ~Unclaim() noexcept {
+            if (pool != nullptr) {
+              lock.lock();
+              --pool->out_;
+              --pool->stats_.constructed;
+              pool->returned_.notify_one();
+            }
+          }
+        } unclaim{ this, lock };
+        //we call constructor out of the lock
+        lock.unlock();
+        Result<Type> made{ constructor() };
+        if (made) {
+          unclaim.pool = nullptr;
+        }
+        return made;
+      }
+
       void give_back_(Type&& value) noexcept {
         auto lock = get_lock_();
         locked_give_back_(std::move(value));
       }
 
+      /*above the high watermark value is left alone, for the caller to destroy once they let go of the lock*/
       void locked_give_back_(Type&& value) noexcept {
+        if (holding_.size() >= limits_.high_watermark) {
+          ++stats_.dropped;
+          note_returned_();
+          return;
+        }
         holding_.emplace_back(std::move(value));
+        ++stats_.returned;
+        note_returned_();
+      }
+
+      /*takes the idle objects predicate picks out of the pool, for the caller to destroy once they let go of the lock*/
+      template<typename Predicate>
+      std::vector<Type_> locked_drop_idle_if_(Predicate&& predicate, size_t keep = 0) {
+        std::vector<Type_> dropping;
+        //oldest are at the front, so they go first
+        auto on = holding_.begin();
+        while (on != holding_.end() && holding_.size() > keep) {
+          if (predicate(static_cast<Type_ const&>(*on))) {
+            dropping.emplace_back(std::move(*on));
+            on = holding_.erase(on);
+          } else {
+            ++on;
+          }
+        }
+        if (!dropping.empty()) {
+          stats_.dropped += dropping.size();
+          returned_.notify_all();
+        }
+        return dropping;
+      }
+
+      /*an object we handed out won't be coming back to the pool*/
+      void locked_forget_() noexcept {
+        ++stats_.dropped;
+        note_returned_();
+      }
+
+      /*value is destroyed rather than given back, making room for another under our max*/
+      void discard_(Type&& value) noexcept {
+        {
+          auto lock = get_lock_();
+          locked_forget_();
+        }
+        Type_ destroying = std::move(value);
       }
 
       [[nodiscard]]
-      auto get_lock_() noexcept {
-        return std::lock_guard{ mutex_ };
+      auto get_lock_() const noexcept {
+        return std::unique_lock{ mutex_ };
       }
     private:
-      Mutex<Concurrency_> mutex_;
+      template<typename>
+      friend struct ::dlib::Pooled;
+
+      /*an object we handed out was destroyed without coming back, so there's room for another*/
+      void note_leaked_() noexcept {
+        auto lock = get_lock_();
+        ++stats_.leaked;
+        note_returned_();
+      }
+
+      bool can_construct_() const noexcept {
+        return holding_.size() + out_ < limits_.max;
+      }
+
+      void note_returned_() noexcept {
+        if (out_ > 0) {
+          --out_;
+        }
+        returned_.notify_one();
+      }
+
+      Pool_limits limits_;
+      mutable Mutex<Concurrency_> mutex_;
+      Condition_variable<Concurrency_> returned_;
       std::vector<Type_> holding_;
+      size_t out_ = 0;
+      Pool_stats stats_{ 0, 0, 0, 0, 0 };
     };
 
     template<typename Type_, typename Concurrency_, typename Pointer_>
@@ -111,21 +466,294 @@ namespace dlib {
       using Pooled = ::dlib::Pooled<Pool>;
       using Pointer_to = Get_pointer_to<typename Base::Pointer_arg, Pool>;
       using Holder = Get_holder<typename Base::Pointer_arg, Pool>;
+      using Pointer = Returning_pointer<Pool>;
+
+      Pool() = default;
+
+      explicit Pool(Pool_limits limits) :
+        Base{ limits } {
+
+      }
+
+      /*pre-warmed with limits.min objects from constructor*/
+      template<typename Constructor>
+      Pool(Pool_limits limits, Constructor&& constructor) :
+        Base{ limits, std::forward<Constructor>(constructor) } {
+
+      }
 
       template<typename Constructor>
-      Result<Pooled> get(Constructor&& constructor) {
+      Result<Pointer> get(Constructor&& constructor) {
         DLIB_TRY(value, (this->get_(std::forward<Constructor>(constructor))));
-        return Pooled( value );
+        return returning_(std::move(value));
       }
 
-      Result<Pooled> get() {
+      Result<Pointer> get() noexcept {
         DLIB_TRY(value, (this->get_()));
-        return Pooled( value );
+        return returning_(std::move(value));
       }
 
-      void give_back(Pooled&& pooled) {
+      /*get, waiting up to timeout for an object to come back if we're out*/
+      template<typename Rep, typename Period>
+      Result<Pointer> get_for(std::chrono::duration<Rep, Period> timeout) noexcept {
+        DLIB_TRY(value, (this->get_for_(timeout)));
+        return returning_(std::move(value));
+      }
+
+      /*get(constructor), waiting up to timeout for an object to come back if we're at our max*/
+      template<typename Constructor, typename Rep, typename Period>
+      Result<Pointer> get_for(Constructor&& constructor, std::chrono::duration<Rep, Period> timeout) {
+        DLIB_TRY(value, (this->get_for_(std::forward<Constructor>(constructor), timeout)));
+        return returning_(std::move(value));
+      }
+
+      /*for what was released from a Pointer, or never came from us*/
+      void give_back(Pooled&& pooled) noexcept {
+        pooled.settle();
         this->give_back_(std::move(pooled.value));
       }
+
+      /*for objects that turned out to be broken, they're destroyed instead of going back*/
+      void discard(Pooled&& pooled) noexcept {
+        pooled.settle();
+        this->discard_(std::move(pooled.value));
+      }
+    private:
+      Pointer returning_(Type_&& value) noexcept {
+        return Pointer{ Pooled(std::move(value), typename Pooled::Info(), this), Return_to_pool_destroyer<Pool>{ this->get_pointer_to(this) } };
+      }
+    };
+
+    /*most threads that get a magazine of their own, past this they share the locked pool*/
+    constexpr size_t max_magazine_threads = 256;
+
+    /*
+    A small id for each live thread, reused once the thread exits, so
+    pools can give threads a slot of their own in a flat array.
+    */
+    class Thread_slots {
+    public:
+      static size_t mine() noexcept {
+        thread_local const Slot slot;
+        return slot.id;
+      }
+    private:
+      struct Registry {
+        std::mutex mutex;
+        std::vector<size_t> free;
+        size_t next = 0;
+      };
+
+      static Registry& registry_() noexcept {
+        static Registry registry;
+        return registry;
+      }
+
+      struct Slot {
+        Slot() noexcept {
+          Registry& registry = registry_();
+          std::lock_guard lock{ registry.mutex };
+          if (registry.free.empty()) {
+            id = registry.next++;
+          } else {
+            id = registry.free.back();
+            registry.free.pop_back();
+          }
+        }
+        ~Slot() noexcept {
+          Registry& registry = registry_();
+          std::lock_guard lock{ registry.mutex };
+          registry.free.push_back(id);
+        }
+        size_t id;
+      };
+    };
+
+    /*
+    Treiber stack of nodes with a next member. The top 16 bits of the head
+    hold a tag bumped on every change, so a node popped and pushed back
+    between our load and our CAS can't fool us (ABA). Nodes must outlive
+    the stack, as a pop may read a node's next after someone else popped it.
+    */
+    template<typename Node>
+    class Tagged_stack {
+    public:
+      static_assert(sizeof(void*) == sizeof(uint64_t), "tagged pointers need 64 bit pointers with a free top 16 bits");
+
+      void push(Node* node) noexcept {
+        assert((reinterpret_cast<uint64_t>(node) & ~pointer_mask_) == 0);
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        do {
+          node->next.store(pointer_(head), std::memory_order_relaxed);
+        } while (!head_.compare_exchange_weak(head, pack_(node, head), std::memory_order_release, std::memory_order_relaxed));
+      }
+
+      Node* pop() noexcept {
+        uint64_t head = head_.load(std::memory_order_acquire);
+        while (pointer_(head) != nullptr) {
+          Node* next = pointer_(head)->next.load(std::memory_order_relaxed);
+          if (head_.compare_exchange_weak(head, pack_(next, head), std::memory_order_acquire, std::memory_order_acquire)) {
+            return pointer_(head);
+          }
+        }
+        return nullptr;
+      }
+    private:
+      static constexpr uint64_t pointer_mask_ = (uint64_t{ 1 } << 48) - 1;
+
+      static Node* pointer_(uint64_t head) noexcept {
+        return reinterpret_cast<Node*>(head & pointer_mask_);
+      }
+
+      /*node, tagged one past what replaces*/
+      static uint64_t pack_(Node* node, uint64_t replacing) noexcept {
+        const uint64_t tag = (replacing & ~pointer_mask_) + (pointer_mask_ + 1);
+        return reinterpret_cast<uint64_t>(node) | tag;
+      }
+
+      std::atomic<uint64_t> head_{ 0 };
+    };
+
+    /*
+    Every thread keeps two magazines (fixed size stacks of objects) to
+    itself, and only swaps whole magazines with the shared depot when both
+    are empty (on get) or full (on give back). So most gets and give backs
+    touch nothing but the thread's own slot, no locks or atomics.
+    Threads past max_magazine_threads fall back to the locked pool.
+    Only what goes through the locked pool shows up in stats(), and
+    in_use() stays 0, what's out can come back to any thread's magazine.
+    */
+    template<typename Type_, typename Concurrency_, typename Pointer_, size_t magazine_size_>
+    class Magazine_pool final :
+      public Pool_base<Type_, Concurrency_, Pointer_> {
+    public:
+      using Base = Pool_base<Type_, Concurrency_, Pointer_>;
+      using Type = Type_;
+      using Pooled = ::dlib::Pooled<Magazine_pool>;
+      using Pointer_to = Get_pointer_to<typename Base::Pointer_arg, Magazine_pool>;
+      using Holder = Get_holder<typename Base::Pointer_arg, Magazine_pool>;
+      using Pointer = Returning_pointer<Magazine_pool>;
+
+      static constexpr size_t magazine_size = magazine_size_;
+      static_assert(magazine_size > 0, "a magazine needs room for an object");
+
+      Magazine_pool() :
+        slots_(max_magazine_threads) {
+
+      }
+      Magazine_pool(Magazine_pool const&) = delete;
+      Magazine_pool& operator=(Magazine_pool const&) = delete;
+      ~Magazine_pool() noexcept {
+        for (Magazine* magazine : magazines_) {
+          delete magazine;
+        }
+      }
+
+      template<typename Constructor>
+      Result<Pointer> get(Constructor&& constructor) {
+        auto got = get_();
+        if (got) {
+          return returning_(std::move(got.value()));
+        }
+        //nothing pooled, we construct with nothing held
+        DLIB_TRY(value, (Result<Type>{ constructor() }));
+        return returning_(std::move(value));
+      }
+
+      Result<Pointer> get() noexcept {
+        DLIB_TRY(value, (get_()));
+        return returning_(std::move(value));
+      }
+
+      void give_back(Pooled&& pooled) noexcept {
+        const size_t id = Thread_slots::mine();
+        if (id >= slots_.size()) {
+          this->give_back_(std::move(pooled.value));
+          return;
+        }
+        Slot& slot = slots_[id];
+        if (slot.loaded == nullptr) {
+          slot.loaded = empty_magazine_();
+        }
+        if (full_(slot.loaded)) {
+          if (slot.previous != nullptr && slot.previous->objects.empty()) {
+            std::swap(slot.loaded, slot.previous);
+          } else {
+            if (slot.previous != nullptr) {
+              full_magazines_.push(slot.previous);
+            }
+            slot.previous = slot.loaded;
+            slot.loaded = empty_magazine_();
+          }
+        }
+        slot.loaded->objects.emplace_back(std::move(pooled.value));
+      }
+    private:
+      struct Magazine {
+        Magazine() {
+          objects.reserve(magazine_size);
+        }
+        std::atomic<Magazine*> next{ nullptr };
+        std::vector<Type> objects;
+      };
+
+      struct alignas(cache_line_size) Slot {
+        Magazine* loaded = nullptr;
+        Magazine* previous = nullptr;
+      };
+
+      /*we don't keep count of what's out, so nothing is tracked as owed back to us*/
+      Pointer returning_(Type&& value) noexcept {
+        return Pointer{ Pooled(std::move(value)), Return_to_pool_destroyer<Magazine_pool>{ this->get_pointer_to(this) } };
+      }
+
+      static bool full_(Magazine const* magazine) noexcept {
+        return magazine->objects.size() == magazine_size;
+      }
+
+      Result<Type> get_() noexcept {
+        const size_t id = Thread_slots::mine();
+        if (id >= slots_.size()) {
+          return this->take_();
+        }
+        Slot& slot = slots_[id];
+        if (slot.loaded == nullptr || slot.loaded->objects.empty()) {
+          if (slot.previous != nullptr && !slot.previous->objects.empty()) {
+            std::swap(slot.loaded, slot.previous);
+          } else {
+            Magazine* full = full_magazines_.pop();
+            if (full == nullptr) {
+              //whatever went through the locked pool is still up for grabs
+              return this->take_();
+            }
+            if (slot.loaded != nullptr) {
+              empty_magazines_.push(slot.loaded);
+            }
+            slot.loaded = full;
+          }
+        }
+        Type value = std::move(slot.loaded->objects.back());
+        slot.loaded->objects.pop_back();
+        return value;
+      }
+
+      Magazine* empty_magazine_() {
+        Magazine* empty = empty_magazines_.pop();
+        if (empty != nullptr) {
+          return empty;
+        }
+        //magazines live as long as we do, the depot relies on it
+        Magazine* made = new Magazine();
+        std::lock_guard lock{ magazines_mutex_ };
+        magazines_.push_back(made);
+        return made;
+      }
+
+      std::vector<Slot> slots_;
+      Tagged_stack<Magazine> full_magazines_;
+      Tagged_stack<Magazine> empty_magazines_;
+      Mutex<Concurrency_> magazines_mutex_;
+      std::vector<Magazine*> magazines_;
     };
 
     template<typename Type_, typename Concurrency_, typename Pointer_>
@@ -139,49 +767,252 @@ namespace dlib {
       using Base = Pool_base<Type_, Concurrency_, Pointer_>;
       using Pointer_to = Get_pointer_to<typename Base::Pointer_arg, Versioned_pool>;
       using Holder = Get_holder<typename Base::Pointer_arg, Versioned_pool>;
-      using Pooled = Pooled<Versioned_pool>;
+      using Pooled = ::dlib::Pooled<Versioned_pool>;
+      using Pointer = Returning_pointer<Versioned_pool>;
 
       Versioned_pool() :
         version_( 0 ) {
 
       }
 
+      explicit Versioned_pool(Pool_limits limits) :
+        Base{ limits },
+        version_( 0 ) {
+
+      }
+
+      /*pre-warmed with limits.min objects from constructor*/
       template<typename Constructor>
-      Result<Pooled> get(Constructor&& constructor) {
+      Versioned_pool(Pool_limits limits, Constructor&& constructor) :
+        Base{ limits, std::forward<Constructor>(constructor) },
+        version_( 0 ) {
+
+      }
+
+      template<typename Constructor>
+      Result<Pointer> get(Constructor&& constructor) {
+        //read first, so if the version moves on while we get, what we got counts as old
+        const Version current = version();
         DLIB_TRY(value, (this->get_(std::forward<Constructor>(constructor))));
+        return returning_(std::move(value), current);
       }
 
-      Result<Pooled> get() noexcept {
+      Result<Pointer> get() noexcept {
+        const Version current = version();
         DLIB_TRY(value, (this->get_()));
-        return Pooled(value, Pooled_info{ atomic_load(&version_) });
+        return returning_(std::move(value), current);
+      }
+
+      /*get, waiting up to timeout for an object to come back if we're out*/
+      template<typename Rep, typename Period>
+      Result<Pointer> get_for(std::chrono::duration<Rep, Period> timeout) noexcept {
+        const Version current = version();
+        DLIB_TRY(value, (this->get_for_(timeout)));
+        return returning_(std::move(value), current);
       }
 
+      /*get(constructor), waiting up to timeout for an object to come back if we're at our max*/
+      template<typename Constructor, typename Rep, typename Period>
+      Result<Pointer> get_for(Constructor&& constructor, std::chrono::duration<Rep, Period> timeout) {
+        const Version current = version();
+        DLIB_TRY(value, (this->get_for_(std::forward<Constructor>(constructor), timeout)));
+        return returning_(std::move(value), current);
+      }
+
+      /*for what was released from a Pointer, stale objects are destroyed rather than kept*/
       void give_back(Pooled&& pooled) noexcept {
-        auto lock = get_lock_();
+        pooled.settle();
+        auto lock = this->get_lock_();
         if (version_ != static_cast<Pooled_info&>(pooled).version) {
+          this->locked_forget_();
+          lock.unlock();
           /* we move it so the previous pooled.value is valid, and it is destroyed here by going out of scope */
-          Type destroying = std::move(pooled.value);
+          [[maybe_unused]] Type_ destroying = std::move(pooled.value);
         } else {
-          locked_give_back_(std::move(pooled.value));
+          this->locked_give_back_(std::move(pooled.value));
         }
       }
 
+      /*for objects that turned out to be broken, they're destroyed instead of going back*/
+      void discard(Pooled&& pooled) noexcept {
+        pooled.settle();
+        this->discard_(std::move(pooled.value));
+      }
+
+      /*everything handed out before now is stale, and anything idle is destroyed*/
       void increment_version() noexcept {
-        auto lock = get_lock_();
-        ++version_;
+        std::vector<Type_> dropping;
+        {
+          //together, so no get can see the new version and still take an old idle object
+          auto lock = this->get_lock_();
+          ++version_;
+          dropping = this->locked_drop_idle_if_([](Type_ const&) { return true; });
+        }
+        //destroyed out of the lock
+      }
+
+      Version version() const noexcept {
+        auto lock = this->get_lock_();
+        return version_;
       }
     private:
+      Pointer returning_(Type_&& value, Version version) noexcept {
+        return Pointer{ Pooled(std::move(value), Pooled_info{ version }, this), Return_to_pool_destroyer<Versioned_pool>{ this->get_pointer_to(this) } };
+      }
+
       Version version_;
     };
-}
+
+    /*
+    One Pool per NUMA node, gets go to the calling thread's node. Objects
+    are constructed by the thread getting them, so they're first touched
+    on its node, and they always go back to the node they came from.
+    */
+    template<typename Type_, typename Concurrency_, typename Pointer_>
+    class Numa_pool final {
+    public:
+      using Type = Type_;
+      using Node_pool = Pool<Type_, Concurrency_, Pointer_>;
+      using Pooled = typename Node_pool::Pooled;
+      using Pointer = typename Node_pool::Pointer;
+
+      Numa_pool() :
+        Numa_pool{ Pool_limits{} } {
+
+      }
+
+      /*limits are for each node*/
+      explicit Numa_pool(Pool_limits limits) :
+        nodes_{ make_per_numa_node<Node_pool>([limits]() { return std::make_unique<Node_pool>(limits); }) } {
+
+      }
+
+      /*every node is pre-warmed with limits.min objects, constructed on that node*/
+      template<typename Constructor>
+      Numa_pool(Pool_limits limits, Constructor&& constructor) :
+        nodes_{ make_per_numa_node<Node_pool>([limits, &constructor]() { return std::make_unique<Node_pool>(limits, constructor); }) } {
+
+      }
+
+      /*from our node, or if it's at its max, whatever another node has idle*/
+      template<typename Constructor>
+      Result<Pointer> get(Constructor&& constructor) {
+        const size_t local = current_numa_node();
+        auto got = nodes_[local]->get(std::forward<Constructor>(constructor));
+        if (got) {
+          return got;
+        }
+        return get_remote_(local);
+      }
+
+      /*from our node, or whatever another node has idle*/
+      Result<Pointer> get() noexcept {
+        const size_t local = current_numa_node();
+        auto got = nodes_[local]->get();
+        if (got) {
+          return got;
+        }
+        return get_remote_(local);
+      }
+
+      /*waits on our node only*/
+      template<typename Rep, typename Period>
+      Result<Pointer> get_for(std::chrono::duration<Rep, Period> timeout) noexcept {
+        return nodes_[current_numa_node()]->get_for(timeout);
+      }
+
+      template<typename Constructor, typename Rep, typename Period>
+      Result<Pointer> get_for(Constructor&& constructor, std::chrono::duration<Rep, Period> timeout) {
+        return nodes_[current_numa_node()]->get_for(std::forward<Constructor>(constructor), timeout);
+      }
+
+      /*back to the node it came from, or ours if it's not from any*/
+      void give_back(Pooled&& pooled) noexcept {
+        node_of_(pooled).give_back(std::move(pooled));
+      }
+
+      void discard(Pooled&& pooled) noexcept {
+        node_of_(pooled).discard(std::move(pooled));
+      }
+
+      size_t node_count() const noexcept {
+        return nodes_.size();
+      }
+
+      Node_pool& node(size_t node) noexcept {
+        return *nodes_[node];
+      }
+
+      size_t idle() const noexcept {
+        size_t total = 0;
+        for (auto const& node : nodes_) {
+          total += node->idle();
+        }
+        return total;
+      }
+
+      size_t in_use() const noexcept {
+        size_t total = 0;
+        for (auto const& node : nodes_) {
+          total += node->in_use();
+        }
+        return total;
+      }
+
+      /*added up over the nodes*/
+      Pool_stats stats() const noexcept {
+        Pool_stats total{ 0, 0, 0, 0, 0 };
+        for (auto const& node : nodes_) {
+          const Pool_stats stats = node->stats();
+          total.recycled += stats.recycled;
+          total.constructed += stats.constructed;
+          total.returned += stats.returned;
+          total.dropped += stats.dropped;
+          total.leaked += stats.leaked;
+        }
+        return total;
+      }
+    private:
+      Result<Pointer> get_remote_(size_t local) noexcept {
+        for (size_t node = 0; node < nodes_.size(); ++node) {
+          if (node == local) {
+            continue;
+          }
+          auto got = nodes_[node]->get();
+          if (got) {
+            return got;
+          }
+        }
+        return error("no node has an object to spare");
+      }
+
+      Node_pool& node_of_(Pooled const& pooled) noexcept {
+        Node_pool* owed_to = pooled.owed_to();
+        return owed_to == nullptr ? *nodes_[current_numa_node()] : *owed_to;
+      }
+
+      std::vector<std::unique_ptr<Node_pool>> nodes_;
+    };
+  }
 
   template<typename Type, typename ...Args>
   using Pool = pool_impl::Pool<Type, 
     First<Get_arg_defaulted<Concurrency_is, List<Std_concurrency>, Args...>>,
     First<Get_arg_defaulted<Pointer_is, List<Raw_pointer>, Args...>>>;
 
+  template<typename Type, typename ...Args>
+  using Magazine_pool = pool_impl::Magazine_pool<Type,
+    First<Get_arg_defaulted<Concurrency_is, List<Std_concurrency>, Args...>>,
+    First<Get_arg_defaulted<Pointer_is, List<Raw_pointer>, Args...>>,
+    value_arg_defaulted<size_t, Magazine_size_is, 32, Args...>>;
+
   template<typename Type, typename ...Args>
   using Versioned_pool = pool_impl::Versioned_pool<Type, 
     First<Get_arg_defaulted<Concurrency_is, List<Std_concurrency>, Args...>>,
     First<Get_arg_defaulted<Pointer_is, List<Raw_pointer>, Args...>>>;
-}
\ No newline at end of file
+
+  template<typename Type, typename ...Args>
+  using Numa_pool = pool_impl::Numa_pool<Type,
+    First<Get_arg_defaulted<Concurrency_is, List<Std_concurrency>, Args...>>,
+    First<Get_arg_defaulted<Pointer_is, List<Raw_pointer>, Args...>>>;
+}
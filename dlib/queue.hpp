@@ -0,0 +1,355 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <memory>
+#include <atomic>
+#include <optional>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+
+#include <dlib/args.hpp>
+#include <dlib/arrays.hpp>
+#include <dlib/concurrency.hpp>
+
+/*
+Bounded queues for handing values between threads, such as messages
+coming in to be applied or writes waiting to be batched.
+
+Mpmc_queue takes any number of producers and consumers (Vyukov's bounded
+queue, each slot carries a sequence number saying whose turn it is).
+Spsc_ring is for exactly one producer and one consumer, and only needs the
+two indices.
+
+Neither blocks: pushing to a full queue or popping from an empty one just
+does nothing. push_n and pop_n move as many values as they can in one go,
+claiming the whole run of slots at once rather than one at a time.
+
+Capacities are rounded up to a power of two.
+*/
+
+namespace dlib {
+  namespace queue_impl {
+    /*Atomic<Concurrency, T> is a plain T without threads*/
+    template<typename Value>
+    Value load_(Value const& value, std::memory_order) noexcept {
+      return value;
+    }
+
+    template<typename Value>
+    Value load_(std::atomic<Value> const& value, std::memory_order order) noexcept {
+      return value.load(order);
+    }
+
+    template<typename Value>
+    void store_(Value& to, Value value, std::memory_order) noexcept {
+      to = value;
+    }
+
+    template<typename Value>
+    void store_(std::atomic<Value>& to, Value value, std::memory_order order) noexcept {
+      to.store(value, order);
+    }
+
+    template<typename Value>
+    bool compare_exchange_(Value& value, Value& expected, Value desired) noexcept {
+      if (value != expected) {
+        expected = value;
+        return false;
+      }
+      value = desired;
+      return true;
+    }
+
+    template<typename Value>
+    bool compare_exchange_(std::atomic<Value>& value, Value& expected, Value desired) noexcept {
+      return value.compare_exchange_weak(expected, desired, std::memory_order_relaxed, std::memory_order_relaxed);
+    }
+
+    inline size_t round_up_capacity_(size_t capacity) noexcept {
+      size_t rounded = 2;
+      while (rounded < capacity) {
+        rounded <<= 1;
+      }
+      return rounded;
+    }
+
+    /*how far ahead a sequence is of where we wanted it, negative if it's behind*/
+    inline intptr_t distance_(size_t sequence, size_t wanted) noexcept {
+      return static_cast<intptr_t>(sequence - wanted);
+    }
+
+    template<typename Type>
+    struct Storage {
+      alignas(Type) std::byte bytes[sizeof(Type)];
+
+      Type* get() noexcept {
+        return std::launder(reinterpret_cast<Type*>(bytes));
+      }
+    };
+
+    template<typename Type_, typename Concurrency_>
+    class Mpmc_queue {
+    public:
+      using Type = Type_;
+      using Concurrency_arg = Concurrency_;
+
+      explicit Mpmc_queue(size_t capacity) :
+        mask_{ round_up_capacity_(capacity) - 1 },
+        cells_{ std::make_unique<Cell[]>(mask_ + 1) } {
+        //a cell is free for the push at its index, and each lap adds the capacity
+        for (size_t i = 0; i <= mask_; ++i) {
+          store_(cells_[i].sequence, i, std::memory_order_relaxed);
+        }
+      }
+      Mpmc_queue(Mpmc_queue const&) = delete;
+      Mpmc_queue& operator=(Mpmc_queue const&) = delete;
+      ~Mpmc_queue() noexcept {
+        while (try_pop()) {
+
+        }
+      }
+
+      /*false if we're full, value is only moved from if it went in*/
+      bool try_push(Type&& value) noexcept {
+        return push_n(Array_view<Type>{ &value, 1 }) == 1;
+      }
+
+      bool try_push(Type const& value) noexcept {
+        Type copy{ value };
+        return try_push(std::move(copy));
+      }
+
+      /*nullopt if we're empty*/
+      std::optional<Type> try_pop() noexcept {
+        std::optional<Type> popped;
+        size_t position = load_(dequeue_, std::memory_order_relaxed);
+        for (;;) {
+          Cell& cell = cells_[position & mask_];
+          const intptr_t ahead = distance_(load_(cell.sequence, std::memory_order_acquire), position + 1);
+          if (ahead < 0) {
+            return popped;
+          }
+          if (ahead > 0) {
+            position = load_(dequeue_, std::memory_order_relaxed);
+          } else if (compare_exchange_(dequeue_, position, position + 1)) {
+            break;
+          }
+        }
+        Cell& cell = cells_[position & mask_];
+        Type* value = cell.storage.get();
+        popped.emplace(std::move(*value));
+        value->~Type();
+        store_(cell.sequence, position + mask_ + 1, std::memory_order_release);
+        return popped;
+      }
+
+      /*moves values in from the front of values until we're full, returns how many*/
+      size_t push_n(Array_view<Type> values) noexcept {
+        size_t pushed = 0;
+        while (pushed < values.size()) {
+          size_t position = load_(enqueue_, std::memory_order_relaxed);
+          const size_t free = ready_(position, values.size() - pushed, 0);
+          if (free == 0) {
+            if (distance_(load_(cells_[position & mask_].sequence, std::memory_order_acquire), position) < 0) {
+              return pushed;
+            }
+            //another producer got there first
+            continue;
+          }
+          if (!compare_exchange_(enqueue_, position, position + free)) {
+            continue;
+          }
+          for (size_t i = 0; i < free; ++i) {
+            Cell& cell = cells_[(position + i) & mask_];
+            new (cell.storage.bytes) Type(std::move(values[pushed + i]));
+            store_(cell.sequence, position + i + 1, std::memory_order_release);
+          }
+          pushed += free;
+        }
+        return pushed;
+      }
+
+      /*moves values out into the front of out until we're empty, returns how many*/
+      size_t pop_n(Array_view<Type> out) noexcept {
+        size_t popped = 0;
+        while (popped < out.size()) {
+          size_t position = load_(dequeue_, std::memory_order_relaxed);
+          const size_t ready = ready_(position, out.size() - popped, 1);
+          if (ready == 0) {
+            if (distance_(load_(cells_[position & mask_].sequence, std::memory_order_acquire), position + 1) < 0) {
+              return popped;
+            }
+            continue;
+          }
+          if (!compare_exchange_(dequeue_, position, position + ready)) {
+            continue;
+          }
+          for (size_t i = 0; i < ready; ++i) {
+            Cell& cell = cells_[(position + i) & mask_];
+            Type* value = cell.storage.get();
+            out[popped + i] = std::move(*value);
+            value->~Type();
+            store_(cell.sequence, position + i + mask_ + 1, std::memory_order_release);
+          }
+          popped += ready;
+        }
+        return popped;
+      }
+
+      size_t capacity() const noexcept {
+        return mask_ + 1;
+      }
+
+      /*only a snapshot, other threads may have pushed or popped since*/
+      size_t size() const noexcept {
+        const size_t dequeued = load_(dequeue_, std::memory_order_relaxed);
+        const size_t enqueued = load_(enqueue_, std::memory_order_relaxed);
+        return std::min(capacity(), enqueued >= dequeued ? enqueued - dequeued : 0);
+      }
+
+      bool empty() const noexcept {
+        return size() == 0;
+      }
+    private:
+      struct Cell {
+        Atomic<Concurrency_arg, size_t> sequence;
+        Storage<Type> storage;
+      };
+
+      /*how many cells from position on, up to most, are ready for us (offset 0 to push, 1 to pop)*/
+      size_t ready_(size_t position, size_t most, size_t offset) const noexcept {
+        size_t ready = 0;
+        while (ready < most && load_(cells_[(position + ready) & mask_].sequence, std::memory_order_acquire) == position + ready + offset) {
+          ++ready;
+        }
+        return ready;
+      }
+
+      const size_t mask_;
+      std::unique_ptr<Cell[]> cells_;
+      //producers and consumers each hammer their own index, so they get a line each
+      alignas(cache_line_size) Atomic<Concurrency_arg, size_t> enqueue_{ 0 };
+      alignas(cache_line_size) Atomic<Concurrency_arg, size_t> dequeue_{ 0 };
+    };
+
+    template<typename Type_, typename Concurrency_>
+    class Spsc_ring {
+    public:
+      using Type = Type_;
+      using Concurrency_arg = Concurrency_;
+
+      explicit Spsc_ring(size_t capacity) :
+        mask_{ round_up_capacity_(capacity) - 1 },
+        slots_{ std::make_unique<Storage<Type>[]>(mask_ + 1) } {
+
+      }
+      Spsc_ring(Spsc_ring const&) = delete;
+      Spsc_ring& operator=(Spsc_ring const&) = delete;
+      ~Spsc_ring() noexcept {
+        const size_t tail = load_(tail_, std::memory_order_acquire);
+        for (size_t head = load_(head_, std::memory_order_relaxed); head != tail; ++head) {
+          slots_[head & mask_].get()->~Type();
+        }
+      }
+
+      /*producer only, false if we're full, value is only moved from if it went in*/
+      bool try_push(Type&& value) noexcept {
+        return push_n(Array_view<Type>{ &value, 1 }) == 1;
+      }
+
+      bool try_push(Type const& value) noexcept {
+        Type copy{ value };
+        return try_push(std::move(copy));
+      }
+
+      /*consumer only, nullopt if we're empty*/
+      std::optional<Type> try_pop() noexcept {
+        std::optional<Type> popped;
+        const size_t head = load_(head_, std::memory_order_relaxed);
+        if (readable_(head, 1) == 0) {
+          return popped;
+        }
+        Type* value = slots_[head & mask_].get();
+        popped.emplace(std::move(*value));
+        value->~Type();
+        store_(head_, head + 1, std::memory_order_release);
+        return popped;
+      }
+
+      /*producer only, moves values in from the front of values until we're full, returns how many*/
+      size_t push_n(Array_view<Type> values) noexcept {
+        const size_t tail = load_(tail_, std::memory_order_relaxed);
+        const size_t pushing = writable_(tail, values.size());
+        for (size_t i = 0; i < pushing; ++i) {
+          new (slots_[(tail + i) & mask_].bytes) Type(std::move(values[i]));
+        }
+        //one release publishes the whole run
+        store_(tail_, tail + pushing, std::memory_order_release);
+        return pushing;
+      }
+
+      /*consumer only, moves values out into the front of out until we're empty, returns how many*/
+      size_t pop_n(Array_view<Type> out) noexcept {
+        const size_t head = load_(head_, std::memory_order_relaxed);
+        const size_t popping = readable_(head, out.size());
+        for (size_t i = 0; i < popping; ++i) {
+          Type* value = slots_[(head + i) & mask_].get();
+          out[i] = std::move(*value);
+          value->~Type();
+        }
+        store_(head_, head + popping, std::memory_order_release);
+        return popping;
+      }
+
+      size_t capacity() const noexcept {
+        return mask_ + 1;
+      }
+
+      /*only a snapshot, unless called from the producer or consumer*/
+      size_t size() const noexcept {
+        const size_t head = load_(head_, std::memory_order_acquire);
+        const size_t tail = load_(tail_, std::memory_order_acquire);
+        return tail - head;
+      }
+
+      bool empty() const noexcept {
+        return size() == 0;
+      }
+    private:
+      /*only goes back to the consumer's index when what we last saw of it isn't enough*/
+      size_t writable_(size_t tail, size_t most) noexcept {
+        if (capacity() - (tail - head_seen_) < most) {
+          head_seen_ = load_(head_, std::memory_order_acquire);
+        }
+        return std::min(most, capacity() - (tail - head_seen_));
+      }
+
+      size_t readable_(size_t head, size_t most) noexcept {
+        if (tail_seen_ - head < most) {
+          tail_seen_ = load_(tail_, std::memory_order_acquire);
+        }
+        return std::min(most, tail_seen_ - head);
+      }
+
+      const size_t mask_;
+      std::unique_ptr<Storage<Type>[]> slots_;
+      //the producer's line: its index, and the last consumer index it saw
+      alignas(cache_line_size) Atomic<Concurrency_arg, size_t> tail_{ 0 };
+      size_t head_seen_ = 0;
+      //the consumer's line
+      alignas(cache_line_size) Atomic<Concurrency_arg, size_t> head_{ 0 };
+      size_t tail_seen_ = 0;
+    };
+  }
+
+  template<typename Type, typename ...Args>
+  using Mpmc_queue = queue_impl::Mpmc_queue<Type,
+    First<Get_arg_defaulted<Concurrency_is, List<Std_concurrency>, Args...>>>;
+
+  template<typename Type, typename ...Args>
+  using Spsc_ring = queue_impl::Spsc_ring<Type,
+    First<Get_arg_defaulted<Concurrency_is, List<Std_concurrency>, Args...>>>;
+}
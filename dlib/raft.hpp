@@ -1,15 +1,60 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
 #include <variant>
 #include <vector>
 #include <chrono>
 #include <memory>
 #include <cmath>
+#include <algorithm>
+#include <utility>
+#include <limits>
+#include <type_traits>
 
 #include <dlib/arrays.hpp>
 #include <dlib/args.hpp>
 
+/*
+Raft, with storage, the network and timers left to a Driver:
+
+  struct Driver {
+    Term currentTerm();
+    void currentTerm(Term term);
+    Vote votedFor();
+    void votedFor(Vote who);
+    Index written();                                            //the last index in the log, 0 if it's empty
+    Term readTerm(Index index);                                 //0 for index 0, the snapshot's term for its last index
+    std::shared_ptr<Array_view<std::byte>> readData(Index index);
+    void writeEntries(Index location, Array_view<Entry> entries); //from location on, dropping anything after
+    Index committed();
+    void committed(Index entry);
+    void flush();                                               //makes everything written so far durable, term and vote included
+    EntryInfo snapshotInfo();                                   //the last entry the snapshot covers, {0, 0} without one
+    std::shared_ptr<Array_view<std::byte>> snapshot();
+    void compact(EntryInfo through);                            //snapshots what's been applied, which is through, and drops it from the log
+    void snapshotChunk(EntryInfo snapshot, uint64_t offset, Array_view<std::byte> data); //part of the leader's, offset 0 starts a new one
+    void installSnapshot(EntryInfo snapshot);                   //replaces what's been applied with the chunks received. the log is dropped
+                                                                //through snapshot.index, and after it too unless the entry there has snapshot.term
+    void apply(Array_view<std::byte> data);                     //committed entries, in order
+    void setTimeout(std::chrono::milliseconds till, TimeoutToken token); //call timeout(token) after till
+    std::chrono::milliseconds followerTimeout();
+    std::chrono::milliseconds candidateTimeout();
+    std::chrono::milliseconds leaderTimeout();
+    void send(NodeId who, AppendEntries rpc);                   //and the other rpcs, views are only valid for the call
+  };
+
+Log indices start at 1. Once compacted, entries up to snapshotInfo().index
+are only in the snapshot, though written() still counts them.
+
+With groupCommit, Raft never calls Driver::flush itself. It calls it on the
+next Raft::flush() instead, which the driver makes after each batch of
+messages or on a short timer. One flush then covers all the appends, terms
+and votes since the last one. Replies and vote requests wait for that
+flush. A leader's AppendEntries go straight out, but it only counts itself
+towards a commit once its own entries are durable.
+*/
+
 namespace dlib::raft {
 
   using Term = uint64_t;
@@ -32,6 +77,16 @@ namespace dlib::raft {
     NodeId peer;
     Index nextIndex;
     Index matchIndex;
+    //AppendEntries sent that we haven't heard back about
+    size_t inFlight;
+    //moves on when what's in flight is written off, replies sent back before then are ignored
+    uint64_t window;
+    //we don't know where our logs match yet, so one AppendEntries at a time and nextIndex only moves on replies
+    bool probing;
+    //if it needs entries we've compacted away, the snapshot we're sending it and how far through it we are
+    Index snapshotIndex;
+    uint64_t snapshotOffset;
+    uint64_t snapshotBytes;
   };
 
   struct LeaderState {
@@ -57,11 +112,20 @@ namespace dlib::raft {
     Term leadersPrevLogTerm;
     Index leadersCommitIndex;
     Array_view<Entry> entries;
+    //the follower's window, which goes back in the reply
+    uint64_t window;
   };
 
   struct AppendEntriesReply {
     Term currentTerm;
     Result success;
+    //on success, how far our log now matches the leader's
+    Index lastIndex;
+    //on failure, our term at the leader's prev (0 if we don't have it) and the first index we have of that term,
+    //or where our log ends if we don't have it. lets the leader skip a whole term at a time
+    Term conflictTerm;
+    Index conflictIndex;
+    uint64_t window;
   };
 
   struct RequestVote {
@@ -80,13 +144,62 @@ namespace dlib::raft {
     Term term;
   };
 
+  /*a piece of the leader's snapshot, they go in order and done marks the last*/
+  struct InstallSnapshot {
+    Term leadersTerm;
+    EntryInfo lastIncluded;
+    uint64_t offset;
+    Array_view<std::byte> data;
+    bool done;
+    uint64_t window;
+  };
+
+  struct InstallSnapshotReply {
+    Term currentTerm;
+    Result success;
+    EntryInfo lastIncluded;
+    //how much of the snapshot we have, on failure where the leader should carry on from
+    uint64_t received;
+    uint64_t window;
+  };
+
+  /*How much a leader puts in one AppendEntries, how many it keeps in flight to each follower, and when logs get compacted*/
+  struct ReplicationOptions {
+    size_t maxEntries = 64;
+    //an entry bigger than this still goes, on its own
+    size_t maxBytes = 1024 * 1024;
+    //past 1, the next batch goes before the last is acknowledged, with nextIndex moved on as if it will be
+    size_t maxInFlight = 1;
+    //snapshots go in pieces this big, with the same window
+    size_t snapshotChunkBytes = 64 * 1024;
+    //once this many committed entries are in the log they're snapshotted and dropped from it, 0 never compacts
+    Index compactAfter = 0;
+    //flush only when Raft::flush() is called, holding back what needs it till then
+    bool groupCommit = false;
+  };
+
+  template<typename Driver>
   class Raft {
   public:
-    Raft() :
-      volatileState_{} {
+    Raft(NodeId me, std::vector<NodeId> peers, Driver driver, ReplicationOptions replication = ReplicationOptions{}) :
+      driver_{ std::move(driver) },
+      volatileState_{},
+      me_{ me },
+      peers_{ std::move(peers) },
+      timeoutToken_{ 0 },
+      replication_{ replication },
+      receiving_{ EntryInfo{ 0, 0 }, 0 },
+      dirty_{ false },
+      durable_{ 0 } {
 
     }
 
+    /*starts us off as a follower, waiting to hear from a leader*/
+    void start() noexcept {
+      goToFollower_();
+      setFollowerTimeout_();
+    }
+
     void timeout(TimeoutToken token) noexcept {
       if (token != timeoutToken_) {
         //old timeout, ignore
@@ -95,40 +208,174 @@ namespace dlib::raft {
       return std::visit([this](auto&& state) { return this->timeout_(std::forward<decltype(state)>(state)); }, volatileState_);
     }
 
+    /*
+    with groupCommit, makes everything since the last flush durable in one go, then sends
+    what was waiting on it. does nothing if there's nothing to flush
+    */
+    void flush() noexcept {
+      if (!dirty_) {
+        return;
+      }
+      dirty_ = false;
+      driver_.flush();
+      durable_ = written_();
+
+      std::vector<Held> held = std::move(held_);
+      held_.clear();
+      for (Held& sending : held) {
+        std::visit([this, &sending](auto const& rpc) { this->send_(sending.who, rpc); }, sending.rpc);
+      }
+
+      if (isLeader()) {
+        //what the followers already have may only have been waiting on us
+        LeaderState& state = std::get<LeaderState>(volatileState_);
+        const Term currentTerm = currentTerm_();
+        tryLeaderCommit_(state, currentTerm, durable_);
+        for (FollowerInfo const& follower : state.followers) {
+          tryLeaderCommit_(state, currentTerm, follower.matchIndex);
+        }
+      }
+    }
+
+    /*appends data to our log if we're the leader, followers with room in their window get it right away*/
+    Result propose(Array_view<std::byte> data) noexcept {
+      if (!isLeader()) {
+        return Result::Failure;
+      }
+      Entry entry{ currentTerm_(), data };
+      writeEntries_(written_() + 1, Array_view<Entry>{ &entry, 1 });
+      flush_();
+
+      LeaderState& state = std::get<LeaderState>(volatileState_);
+      const Index written = written_();
+      const Term currentTerm = currentTerm_();
+      const Index commitIndex = committed_();
+      for (FollowerInfo& follower : state.followers) {
+        replicate_(written, currentTerm, commitIndex, follower);
+      }
+      return Result::Success;
+    }
+
     void recv(NodeId from, AppendEntries rpc) noexcept {
 
       Term currentTerm = currentTerm_();
 
       if (rpc.leadersTerm < currentTerm) { //leader is old
-        send_(from, AppendEntriesReply{ currentTerm, Result::Failure });
+        return send_(from, AppendEntriesReply{ currentTerm, Result::Failure, 0, 0, 0, rpc.window });
       } else if (rpc.leadersTerm > currentTerm) { //leader is new
-        currentTerm_(rpc.leadersTerm);
+        currentTerm = rpc.leadersTerm;
+        currentTerm_(currentTerm);
         flush_();
-        //go to a follower
+      }
+
+      if (!isFollower()) {
+        //there's a leader for this term, and it isn't us
         goToFollower_();
       }
 
+      const EntryInfo snapshotInfo = snapshotInfo_();
+      if (rpc.leadersPrevLogIndex < snapshotInfo.index) {
+        //the start of this is in our snapshot, so committed, so the same as the leader's. only look at what's after it
+        const Index inSnapshot = snapshotInfo.index - rpc.leadersPrevLogIndex;
+        if (inSnapshot >= rpc.entries.size()) {
+          send_(from, AppendEntriesReply{ currentTerm, Result::Success, rpc.leadersPrevLogIndex + rpc.entries.size(), 0, 0, rpc.window });
+          return setFollowerTimeout_();
+        }
+        rpc.leadersPrevLogIndex = snapshotInfo.index;
+        rpc.leadersPrevLogTerm = snapshotInfo.term;
+        rpc.entries = Array_view<Entry>{ rpc.entries.data() + inSnapshot, rpc.entries.size() - inSnapshot };
+      }
+
       Index written = written_();
 
       if (written < rpc.leadersPrevLogIndex) { //we aren't as up to date as the leader's prev
-        return send_(from, AppendEntriesReply{ currentTerm, Result::Failure });
+        send_(from, AppendEntriesReply{ currentTerm, Result::Failure, 0, 0, written + 1, rpc.window });
+        return setFollowerTimeout_();
       }
 
       Term prevTerm = readTerm_(rpc.leadersPrevLogIndex);
 
       if (prevTerm != rpc.leadersPrevLogTerm) { //prev log term's don't match
-        return send_(from, AppendEntriesReply{currentTerm, Result::Failure});
+        //everything we have of prevTerm is suspect, not just prev
+        Index firstOfTerm = rpc.leadersPrevLogIndex;
+        while (firstOfTerm > snapshotInfo.index + 1 && readTerm_(firstOfTerm - 1) == prevTerm) {
+          --firstOfTerm;
+        }
+        send_(from, AppendEntriesReply{ currentTerm, Result::Failure, 0, prevTerm, firstOfTerm, rpc.window });
+        return setFollowerTimeout_();
       }
 
-      writeEntries_(rpc.leadersPrevLogIndex + 1, rpc.entries);
+      //entries we already have are left alone, so an old AppendEntries can't cut off newer ones
+      size_t have = 0;
+      while (have < rpc.entries.size()
+        && rpc.leadersPrevLogIndex + have + 1 <= written
+        && readTerm_(rpc.leadersPrevLogIndex + have + 1) == rpc.entries[have].term) {
+        ++have;
+      }
+      if (have < rpc.entries.size()) {
+        writeEntries_(rpc.leadersPrevLogIndex + have + 1, Array_view<Entry>{ rpc.entries.data() + have, rpc.entries.size() - have });
+      }
 
-      committed_(rpc.leadersCommitIndex);
+      const Index lastNew = rpc.leadersPrevLogIndex + rpc.entries.size();
+      const Index committed = committed_();
 
       flush_();
 
-      send_(from, AppendEntriesReply{ currentTerm, Result::Success });
+      send_(from, AppendEntriesReply{ currentTerm, Result::Success, lastNew, 0, 0, rpc.window });
 
-      tryNewCommitted_(committed_(), rpc.leadersCommitIndex);
+      tryNewCommitted_(committed, std::min(rpc.leadersCommitIndex, lastNew));
+
+      return setFollowerTimeout_();
+    }
+
+    void recv(NodeId from, InstallSnapshot rpc) noexcept {
+
+      Term currentTerm = currentTerm_();
+
+      if (rpc.leadersTerm < currentTerm) { //leader is old
+        return send_(from, InstallSnapshotReply{ currentTerm, Result::Failure, rpc.lastIncluded, 0, rpc.window });
+      } else if (rpc.leadersTerm > currentTerm) { //leader is new
+        currentTerm = rpc.leadersTerm;
+        currentTerm_(currentTerm);
+        flush_();
+      }
+
+      if (!isFollower()) {
+        //there's a leader for this term, and it isn't us
+        goToFollower_();
+      }
+
+      if (rpc.lastIncluded.index <= committed_()) {
+        //we already have everything it covers
+        send_(from, InstallSnapshotReply{ currentTerm, Result::Success, rpc.lastIncluded, std::numeric_limits<uint64_t>::max(), rpc.window });
+        return setFollowerTimeout_();
+      }
+
+      if (rpc.offset == 0) {
+        receiving_ = ReceivingSnapshot{ rpc.lastIncluded, 0 };
+      }
+
+      const bool sameSnapshot = receiving_.lastIncluded.index == rpc.lastIncluded.index
+        && receiving_.lastIncluded.term == rpc.lastIncluded.term;
+
+      if (!sameSnapshot || rpc.offset != receiving_.received) {
+        //a chunk went missing, or it's from a snapshot we aren't getting. tell the leader where to carry on from
+        send_(from, InstallSnapshotReply{ currentTerm, Result::Failure, rpc.lastIncluded, sameSnapshot ? receiving_.received : 0, rpc.window });
+        return setFollowerTimeout_();
+      }
+
+      snapshotChunk_(rpc.lastIncluded, rpc.offset, rpc.data);
+      const uint64_t received = receiving_.received += rpc.data.size();
+
+      if (rpc.done) {
+        installSnapshot_(rpc.lastIncluded);
+        //what's in it is committed, and already applied by installing it
+        committed_(rpc.lastIncluded.index);
+        flush_();
+        receiving_ = ReceivingSnapshot{ EntryInfo{ 0, 0 }, 0 };
+      }
+
+      send_(from, InstallSnapshotReply{ currentTerm, Result::Success, rpc.lastIncluded, received, rpc.window });
 
       return setFollowerTimeout_();
     }
@@ -141,6 +388,17 @@ namespace dlib::raft {
         return send_(from, RequestVoteReply{ ourTerm, Result::Failure });
       }
 
+      if (rpc.candidatesTerm > ourTerm) {
+        //a new term, whatever we were doing in ours is over
+        ourTerm = rpc.candidatesTerm;
+        currentTerm_(ourTerm);
+        flush_();
+        if (!isFollower()) {
+          goToFollower_();
+          setFollowerTimeout_();
+        }
+      }
+
       Vote ourVote = votedFor_();
 
       if (ourVote.when > rpc.candidatesTerm) {
@@ -199,38 +457,120 @@ namespace dlib::raft {
 
       LeaderState& state = std::get<LeaderState>(volatileState_);
 
-      const auto fromFollower = std::find_if(
-        state.followers.begin(),
-        state.followers.end(),
-        [from](FollowerInfo checking) { return checking.peer == from;});
+      FollowerInfo* const fromFollower = findFollower_(state, from);
 
-      if (fromFollower == state.followers.end()) {
+      if (fromFollower == nullptr) {
         //from non existent follower?
         return;
       }
 
-      fromFollower->matchIndex = fromFollower->nextIndex;
-      ++fromFollower->nextIndex;
+      if (rpc.window != fromFollower->window) {
+        //about sends we've written off. a failure was already dealt with, but what the follower has is still true
+        if (rpc.success == Result::Success) {
+          fromFollower->matchIndex = std::max(fromFollower->matchIndex, rpc.lastIndex);
+          fromFollower->nextIndex = std::max(fromFollower->nextIndex, fromFollower->matchIndex + 1);
+          tryLeaderCommit_(state, currentTerm, fromFollower->matchIndex);
+        }
+        return;
+      }
+
+      if (fromFollower->inFlight > 0) {
+        --fromFollower->inFlight;
+      }
 
-      const auto quorumCount = quorumCount_();
+      if (rpc.success == Result::Failure) {
+        if (!fromFollower->probing) {
+          //everything else in flight went after the same bad guess
+          fromFollower->probing = true;
+          writeOff_(*fromFollower);
+        }
+        //jump back to where the follower says we differ, but never past what it's acknowledged.
+        //an old reply can't take us forwards
+        const Index hinted = conflictHint_(rpc, fromFollower->nextIndex - 1);
+        fromFollower->nextIndex = std::max(fromFollower->matchIndex + 1, std::min(fromFollower->nextIndex, hinted));
+      } else {
+        //replies can come back out of order, so an old one can't take us backwards
+        fromFollower->matchIndex = std::max(fromFollower->matchIndex, rpc.lastIndex);
+        fromFollower->nextIndex = std::max(fromFollower->nextIndex, fromFollower->matchIndex + 1);
+        fromFollower->probing = false;
+      }
 
-      const Index committed = committed_();
+      tryLeaderCommit_(state, currentTerm, fromFollower->matchIndex);
 
-      if (fromFollower->matchIndex > committed) {
-        const auto commitCount = std::count_if(
-          state.followers.begin(),
-          state.followers.end(),
-          [fromFollower](FollowerInfo checking) {return checking.matchIndex >= fromFollower->matchIndex;});
+      const Index written = written_();
+      if (rpc.success == Result::Failure && fromFollower->inFlight == 0) {
+        //probe even if there's nothing new, the follower still needs what it's missing
+        sendAppendEntries_(written, currentTerm, committed_(), *fromFollower);
+      } else {
+        replicate_(written, currentTerm, committed_(), *fromFollower);
+      }
+    }
 
-        if (commitCount >= quorumCount) {
-          tryNewCommitted_(committed, fromFollower->matchIndex);
-        }
+    void recv(NodeId from, InstallSnapshotReply rpc) {
+      Term currentTerm = currentTerm_();
+
+      if (rpc.currentTerm < currentTerm) {
+        //old, ignore
+        return;
+      }
+
+      if (rpc.currentTerm > currentTerm) {
+        //from the future?
+        currentTerm_(rpc.currentTerm);
+        flush_();
+        goToFollower_();
+        setFollowerTimeout_();
+        return;
+      }
+
+      if (!isLeader()) {
+        //confusing, just ignore though?
+        return;
+      }
+
+      FollowerInfo* const fromFollower = findFollower_(std::get<LeaderState>(volatileState_), from);
+
+      if (fromFollower == nullptr) {
+        //from non existent follower?
+        return;
+      }
+
+      if (rpc.window != fromFollower->window) {
+        //about sends we've written off, the next one asks again
+        return;
+      }
+
+      if (fromFollower->inFlight > 0) {
+        --fromFollower->inFlight;
+      }
+
+      if (rpc.lastIncluded.index != fromFollower->snapshotIndex) {
+        //about a snapshot we've since stopped sending
+      } else if (rpc.success == Result::Failure) {
+        //everything else in flight is after the gap too
+        writeOff_(*fromFollower);
+        fromFollower->snapshotOffset = rpc.received;
+      } else if (rpc.received >= fromFollower->snapshotBytes) {
+        //installed, entries from after it can follow
+        fromFollower->matchIndex = std::max(fromFollower->matchIndex, rpc.lastIncluded.index);
+        fromFollower->nextIndex = std::max(fromFollower->nextIndex, fromFollower->matchIndex + 1);
+        fromFollower->probing = false;
+        fromFollower->snapshotIndex = 0;
+        fromFollower->snapshotOffset = 0;
+        fromFollower->snapshotBytes = 0;
+      }
+
+      const Index written = written_();
+      if (rpc.success == Result::Failure && fromFollower->inFlight == 0) {
+        sendAppendEntries_(written, currentTerm, committed_(), *fromFollower);
+      } else {
+        replicate_(written, currentTerm, committed_(), *fromFollower);
       }
     }
 
     void recv(NodeId from, RequestVoteReply rpc) {
       Term currentTerm = currentTerm_();
-      
+
       if (rpc.currentTerm < currentTerm) {
         //old, ignore
         return;
@@ -245,14 +585,14 @@ namespace dlib::raft {
         return;
       }
 
-      if (!isCandidate()) {
+      if (!isCandidate() || rpc.voteGranted == Result::Failure) {
         //confusing, just ignore though?
         return;
       }
 
       auto votesFor = ++std::get<CandidateState>(volatileState_).votesReceived;
 
-      if (votesFor > quorumCount_()) {
+      if (votesFor >= quorumCount_()) {
         goToLeader_(written_(), currentTerm);
         setLeaderTimeout_();
       }
@@ -269,6 +609,18 @@ namespace dlib::raft {
     bool isFollower() const noexcept {
       return std::holds_alternative<FollowerState>(volatileState_);
     }
+
+    NodeId me() const noexcept {
+      return me_;
+    }
+
+    Driver& driver() noexcept {
+      return driver_;
+    }
+
+    Driver const& driver() const noexcept {
+      return driver_;
+    }
   private:
     void timeout_(CandidateState& state) noexcept {
 
@@ -277,11 +629,15 @@ namespace dlib::raft {
       Term writtenTerm = readTerm_(written);
 
       startElection_(currentTerm, written, writtenTerm, state);
-      
+
       setCandidateTimeout_();
     }
 
-    void timeout_(LeaderState const& state) noexcept {
+    void timeout_(LeaderState& state) noexcept {
+      //anything still in flight is as good as lost by now
+      for (FollowerInfo& follower : state.followers) {
+        writeOff_(follower);
+      }
       sendAppendEntries_(state);
       setLeaderTimeout_();
     }
@@ -304,13 +660,13 @@ namespace dlib::raft {
     static bool upToDate_(Index refIndex, Term refTerm, Index checkingIndex, Term checkingTerm) noexcept {
       if (checkingTerm > refTerm) {
         return true;
-      } else if (refTerm < checkingTerm) {
+      } else if (checkingTerm < refTerm) {
         return false;
       } else { //rightTerm == leftTerm
         return checkingIndex >= refIndex;
       }
     }
-    
+
     FollowerState& goToFollower_() noexcept {
       volatileState_ = FollowerState{};
       return std::get<FollowerState>(volatileState_);
@@ -336,7 +692,7 @@ namespace dlib::raft {
       LeaderState& state = std::get<LeaderState>(volatileState_);
 
       for (NodeId peer : peers_) {
-        state.followers.emplace_back(FollowerInfo{ peer, written, Index{0ULL} });
+        state.followers.emplace_back(FollowerInfo{ peer, written + 1, Index{0ULL}, 0, 0, true, Index{0ULL}, 0, 0 });
       }
 
       sendAppendEntries_(state);
@@ -364,18 +720,79 @@ namespace dlib::raft {
       }
     }
 
-    void sendAppendEntries_(LeaderState const& leaderState) noexcept {
+    void sendAppendEntries_(LeaderState& leaderState) noexcept {
       Index written = written_();
       Term currentTerm = currentTerm_();
       Index commitIndex = committed_();
 
-      for (FollowerInfo follower : leaderState.followers) {
+      for (FollowerInfo& follower : leaderState.followers) {
         sendAppendEntries_(written, currentTerm, commitIndex, follower);
       }
     }
 
-    void sendAppendEntries_(Index written, Term currentTerm, Index commitIndex, FollowerInfo to) noexcept {
+    /*
+    Where to try next after a failure: past the last entry we have of the
+    follower's conflicting term, or if we have none, the first it has of it.
+    Only entries up to before are searched, the follower got nothing past it
+    */
+    Index conflictHint_(AppendEntriesReply const& rpc, Index before) noexcept {
+      if (rpc.conflictTerm == 0) {
+        return rpc.conflictIndex;
+      }
+      //anything before our snapshot is gone, but its last entry's term is still known
+      const Index floor = snapshotInfo_().index;
+      Index at = std::max(floor, std::min(before, written_()));
+      Term term = readTerm_(at);
+      while (at > floor && term > rpc.conflictTerm) {
+        --at;
+        term = readTerm_(at);
+      }
+      if (at > 0 && term == rpc.conflictTerm) {
+        return at + 1;
+      }
+      return rpc.conflictIndex;
+    }
+
+    /*sends to a follower while it has something to send and room in its window*/
+    void replicate_(Index written, Term currentTerm, Index commitIndex, FollowerInfo& to) noexcept {
+      const size_t window = to.probing ? 1 : std::max<size_t>(replication_.maxInFlight, 1);
+      while (to.inFlight < window && to.nextIndex <= written && !snapshotSent_(to)) {
+        const Index was = to.nextIndex;
+        const uint64_t wasOffset = to.snapshotOffset;
+        sendAppendEntries_(written, currentTerm, commitIndex, to);
+        if (to.nextIndex == was && to.snapshotOffset == wasOffset) {
+          //nextIndex only moves on replies, sending again would only repeat ourselves
+          break;
+        }
+      }
+    }
+
+    /*forgets what's in flight to a follower, so late replies to it can't free up room for new sends*/
+    static void writeOff_(FollowerInfo& to) noexcept {
+      to.inFlight = 0;
+      ++to.window;
+    }
+
+    /*all of the snapshot's gone out to a follower, and we're waiting to hear it's installed*/
+    bool snapshotSent_(FollowerInfo const& to) noexcept {
+      return to.snapshotIndex != 0
+        && to.nextIndex <= to.snapshotIndex
+        && to.snapshotOffset >= to.snapshotBytes
+        && to.snapshotIndex == snapshotInfo_().index;
+    }
+
+    void sendAppendEntries_(Index written, Term currentTerm, Index commitIndex, FollowerInfo& to) noexcept {
       Index prevIndex = to.nextIndex - 1;
+
+      ++to.inFlight;
+
+      EntryInfo snapshotInfo = snapshotInfo_();
+
+      if (snapshotInfo.index > prevIndex) {
+        //what it needs has been compacted away
+        return sendSnapshot_(currentTerm, snapshotInfo, to);
+      }
+
       Term prevTerm = readTerm_(prevIndex);
 
       if (prevIndex == written) {
@@ -384,30 +801,98 @@ namespace dlib::raft {
           prevIndex,
           prevTerm,
           commitIndex,
-          nullptr};
+          nullptr,
+          to.window };
 
         return send_(to.peer, sending);
       } else {
-        EntryInfo snapshotInfo = snapshotInfo_();
+        AppendEntries sending{
+          currentTerm,
+          prevIndex,
+          prevTerm,
+          commitIndex,
+          nullptr,
+          to.window };
+
+        //as many entries as fit, the data has to live until send_ returns
+        std::vector<std::shared_ptr<Array_view<std::byte>>> data;
+        std::vector<Entry> entries;
+        size_t bytes = 0;
+        const size_t maxEntries = std::max<size_t>(replication_.maxEntries, 1);
+        for (Index at = to.nextIndex; at <= written && entries.size() < maxEntries; ++at) {
+          std::shared_ptr<Array_view<std::byte>> read = readData_(at);
+          if (!entries.empty() && bytes + read->size() > replication_.maxBytes) {
+            break;
+          }
+          bytes += read->size();
+          entries.emplace_back(Entry{ readTerm_(at), *read });
+          data.push_back(std::move(read));
+        }
+        sending.entries = Array_view<Entry>{ entries };
+        if (!to.probing) {
+          //optimistically, a failure puts it back
+          to.nextIndex = prevIndex + entries.size() + 1;
+        }
+        return send_(to.peer, sending);
+      }
+    }
+
+    /*the next chunk of our latest snapshot, starting it over if it's newer than what we were sending*/
+    void sendSnapshot_(Term currentTerm, EntryInfo snapshotInfo, FollowerInfo& to) noexcept {
+      std::shared_ptr<Array_view<std::byte>> snapshot = snapshot_();
+
+      if (to.snapshotIndex != snapshotInfo.index) {
+        to.snapshotIndex = snapshotInfo.index;
+        to.snapshotOffset = 0;
+        to.snapshotBytes = snapshot->size();
+      }
+
+      //past the end sends nothing, but still asks the follower where it's up to
+      const uint64_t offset = std::min<uint64_t>(to.snapshotOffset, snapshot->size());
+      const size_t chunk = static_cast<size_t>(std::min<uint64_t>(
+        std::max<size_t>(replication_.snapshotChunkBytes, 1),
+        snapshot->size() - offset));
+      to.snapshotOffset = offset + chunk;
+
+      InstallSnapshot sending{
+        currentTerm,
+        snapshotInfo,
+        offset,
+        Array_view<std::byte>{ snapshot->data() + offset, chunk },
+        to.snapshotOffset == snapshot->size(),
+        to.window };
+
+      return send_(to.peer, sending);
+    }
+
+    FollowerInfo* findFollower_(LeaderState& state, NodeId peer) noexcept {
+      const auto found = std::find_if(
+        state.followers.begin(),
+        state.followers.end(),
+        [peer](FollowerInfo const& checking) { return checking.peer == peer;});
+      return found == state.followers.end() ? nullptr : &*found;
+    }
 
-        if (snapshotInfo.index > prevIndex) {
-          //send snapshot
-        } else {
-          AppendEntries sending{
-            currentTerm,
-            prevIndex,
-            prevTerm,
-            commitIndex,
-            nullptr};
+    /*commits through index if a majority have it*/
+    void tryLeaderCommit_(LeaderState& state, Term currentTerm, Index index) noexcept {
+      const Index committed = committed_();
 
-          std::vector<Entry> entries;
-          //1 entry for now
-          std::shared_ptr<Array_view<std::byte>> data = readData_(to.nextIndex);
-          Term term = readTerm_(to.nextIndex);
-          entries.emplace_back(Entry{ term, *data });
-          sending.entries = Array_view<Entry>{ entries };
-          return send_(to.peer, sending);
-        };
+      //only entries from our own term are committed by counting, earlier ones come with them
+      if (index <= committed || readTerm_(index) != currentTerm) {
+        return;
+      }
+
+      const auto commitCount = std::count_if(
+        state.followers.begin(),
+        state.followers.end(),
+        [index](FollowerInfo const& checking) {return checking.matchIndex >= index;});
+
+      //we have it too, once it's durable
+      const Index durable = replication_.groupCommit ? durable_ : written_();
+      const auto ours = durable >= index ? 1 : 0;
+
+      if (commitCount + ours >= quorumCount_()) {
+        tryNewCommitted_(committed, index);
       }
     }
 
@@ -420,50 +905,130 @@ namespace dlib::raft {
       if (prevCommitted >= newCommitted) {
         return;
       }
-      
+
       committed_(newCommitted);
       flush_();
       for (Index i = prevCommitted + 1; i <= newCommitted; ++i) {
         commitIndex_(i);
       }
+
+      if (replication_.compactAfter != 0 && newCommitted - snapshotInfo_().index >= replication_.compactAfter) {
+        //everything applied goes into the snapshot, followers that still need it get it from there
+        compact_(EntryInfo{ newCommitted, readTerm_(newCommitted) });
+      }
     }
 
+    /*a majority of everyone, us included*/
     std::intmax_t quorumCount_() const noexcept {
-      return static_cast<std::intmax_t>(std::floor(peers_.size() / 2)) + 1;
-    }
-
-    EntryInfo snapshotInfo_();
-    std::shared_ptr<Array_view<std::byte>> snapshot_();
-    Term currentTerm_();
-    void currentTerm_(Term term);
-    Term readTerm_(Index index);
-    std::shared_ptr<Array_view<std::byte>> readData_(Index index);
-    void writeEntries_(Index location, Array_view<Entry> entries);
-    Index committed_();
-    void committed_(Index entry);
-    Index written_();
-    Vote votedFor_();
-    void votedFor_(Vote who);
-    void startVote_(Term newTerm, Index lastLogIndex, Term lastLogTerm);
-    void flush_();
+      return static_cast<std::intmax_t>((peers_.size() + 1) / 2) + 1;
+    }
+
+    EntryInfo snapshotInfo_() {
+      return driver_.snapshotInfo();
+    }
+    std::shared_ptr<Array_view<std::byte>> snapshot_() {
+      return driver_.snapshot();
+    }
+    void compact_(EntryInfo through) {
+      driver_.compact(through);
+    }
+    void snapshotChunk_(EntryInfo snapshot, uint64_t offset, Array_view<std::byte> data) {
+      driver_.snapshotChunk(snapshot, offset, data);
+    }
+    void installSnapshot_(EntryInfo snapshot) {
+      driver_.installSnapshot(snapshot);
+    }
+    Term currentTerm_() {
+      return driver_.currentTerm();
+    }
+    void currentTerm_(Term term) {
+      driver_.currentTerm(term);
+    }
+    Term readTerm_(Index index) {
+      return driver_.readTerm(index);
+    }
+    std::shared_ptr<Array_view<std::byte>> readData_(Index index) {
+      return driver_.readData(index);
+    }
+    void writeEntries_(Index location, Array_view<Entry> entries) {
+      driver_.writeEntries(location, entries);
+    }
+    Index committed_() {
+      return driver_.committed();
+    }
+    void committed_(Index entry) {
+      driver_.committed(entry);
+    }
+    Index written_() {
+      return driver_.written();
+    }
+    Vote votedFor_() {
+      return driver_.votedFor();
+    }
+    void votedFor_(Vote who) {
+      driver_.votedFor(who);
+    }
+    void flush_() {
+      if (replication_.groupCommit) {
+        dirty_ = true;
+        return;
+      }
+      driver_.flush();
+    }
     template<typename Rep, typename Period>
-    void setTimeout_(std::chrono::duration<Rep,Period> till, TimeoutToken token);
+    void setTimeout_(std::chrono::duration<Rep,Period> till, TimeoutToken token) {
+      driver_.setTimeout(till, token);
+    }
 
     //placeholder, doesn't have to be milliseconds
-    std::chrono::milliseconds followerTimeout_();
-    std::chrono::milliseconds candidateTimeout_();
-    std::chrono::milliseconds leaderTimeout_();
+    std::chrono::milliseconds followerTimeout_() {
+      return driver_.followerTimeout();
+    }
+    std::chrono::milliseconds candidateTimeout_() {
+      return driver_.candidateTimeout();
+    }
+    std::chrono::milliseconds leaderTimeout_() {
+      return driver_.leaderTimeout();
+    }
 
-    void apply_(Array_view<std::byte> data);
+    void apply_(Array_view<std::byte> data) {
+      driver_.apply(data);
+    }
 
-    void send_(NodeId who, AppendEntries appendEntries);
-    void send_(NodeId who, AppendEntriesReply appendEntriesReply);
-    void send_(NodeId who, RequestVote requestVote);
-    void send_(NodeId who, RequestVoteReply requestVoteReply);
+    template<typename Rpc>
+    void send_(NodeId who, Rpc rpc) {
+      //a leader's entries can go out while it writes them itself, everything else says what we've made durable
+      constexpr bool fromLeader = std::is_same_v<Rpc, AppendEntries> || std::is_same_v<Rpc, InstallSnapshot>;
+      if constexpr (!fromLeader) {
+        if (dirty_) {
+          held_.push_back(Held{ who, rpc });
+          return;
+        }
+      }
+      driver_.send(who, rpc);
+    }
 
+    Driver driver_;
     std::variant<std::monostate, CandidateState, FollowerState, LeaderState> volatileState_;
     NodeId me_;
     std::vector<NodeId> peers_;
     TimeoutToken timeoutToken_;
+    ReplicationOptions replication_;
+
+    //the snapshot a leader's sending us, and how much of it we've had
+    struct ReceivingSnapshot {
+      EntryInfo lastIncluded;
+      uint64_t received;
+    };
+    ReceivingSnapshot receiving_;
+
+    //with groupCommit, whether there's anything to flush, what's waiting on it, and how much of the log it's made durable
+    struct Held {
+      NodeId who;
+      std::variant<AppendEntriesReply, InstallSnapshotReply, RequestVote, RequestVoteReply> rpc;
+    };
+    bool dirty_;
+    std::vector<Held> held_;
+    Index durable_;
   };
-}
\ No newline at end of file
+}
@@ -0,0 +1,394 @@
+#pragma once
+
+#include <deque>
+#include <limits>
+#include <optional>
+#include <variant>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include <dlib/raft.hpp>
+
+/*
+A Raft cluster in one process, for tests and benchmarks. Logs live in
+memory, messages wait in one queue until deliver() hands them over, and
+timeouts only fire when asked to, so every run goes the same way. With
+groupCommit, each node flushes once after each fire() and each deliver().
+*/
+
+namespace dlib::raft {
+  class MemoryCluster;
+
+  class MemoryDriver {
+  public:
+    MemoryDriver(MemoryCluster& cluster, NodeId me) noexcept :
+      cluster_{ &cluster },
+      me_{ me } {
+
+    }
+
+    Term currentTerm() const noexcept {
+      return currentTerm_;
+    }
+    void currentTerm(Term term) noexcept {
+      currentTerm_ = term;
+    }
+    Vote votedFor() const noexcept {
+      return votedFor_;
+    }
+    void votedFor(Vote who) noexcept {
+      votedFor_ = who;
+    }
+    Index written() const noexcept {
+      return snapshotInfo_.index + log_.size();
+    }
+    Term readTerm(Index index) const noexcept {
+      if (index == snapshotInfo_.index) {
+        return snapshotInfo_.term;
+      }
+      return index < snapshotInfo_.index || index > written() ? 0 : log_[index - snapshotInfo_.index - 1].term;
+    }
+    std::shared_ptr<Array_view<std::byte>> readData(Index index) const noexcept {
+      return log_[index - snapshotInfo_.index - 1].view;
+    }
+    void writeEntries(Index location, Array_view<Entry> entries) {
+      log_.resize(location - snapshotInfo_.index - 1);
+      for (Entry const& entry : entries) {
+        log_.push_back(Stored{ entry.term, store_(entry.data) });
+      }
+    }
+    Index committed() const noexcept {
+      return committed_;
+    }
+    void committed(Index entry) noexcept {
+      committed_ = entry;
+    }
+    void flush() {
+      ++flushes_;
+      if (onFlush_) {
+        onFlush_();
+      }
+    }
+    EntryInfo snapshotInfo() const noexcept {
+      return snapshotInfo_;
+    }
+    std::shared_ptr<Array_view<std::byte>> snapshot() const noexcept {
+      return snapshot_;
+    }
+    void compact(EntryInfo through) {
+      //our state machine is just the list of what's been applied
+      snapshot_ = store_(encode_(applied_));
+      log_.erase(log_.begin(), log_.begin() + static_cast<ptrdiff_t>(through.index - snapshotInfo_.index));
+      snapshotInfo_ = through;
+    }
+    void snapshotChunk(EntryInfo, uint64_t offset, Array_view<std::byte> data) {
+      if (offset == 0) {
+        receiving_.clear();
+      }
+      receiving_.insert(receiving_.end(), data.begin(), data.end());
+    }
+    void installSnapshot(EntryInfo snapshot) {
+      if (snapshot.index < written() && readTerm(snapshot.index) == snapshot.term) {
+        log_.erase(log_.begin(), log_.begin() + static_cast<ptrdiff_t>(snapshot.index - snapshotInfo_.index));
+      } else {
+        log_.clear();
+      }
+      applied_ = decode_(receiving_);
+      snapshot_ = store_(receiving_);
+      snapshotInfo_ = snapshot;
+      receiving_.clear();
+    }
+    void apply(Array_view<std::byte> data) {
+      applied_.emplace_back(data.begin(), data.end());
+    }
+    void setTimeout(std::chrono::milliseconds, TimeoutToken token) noexcept {
+      timeout_ = token;
+    }
+    std::chrono::milliseconds followerTimeout() const noexcept {
+      return std::chrono::milliseconds{ 150 };
+    }
+    std::chrono::milliseconds candidateTimeout() const noexcept {
+      return std::chrono::milliseconds{ 150 };
+    }
+    std::chrono::milliseconds leaderTimeout() const noexcept {
+      return std::chrono::milliseconds{ 50 };
+    }
+
+    template<typename Rpc>
+    void send(NodeId who, Rpc const& rpc);
+
+    /*the timeout waiting to fire, if there is one*/
+    std::optional<TimeoutToken> pendingTimeout() const noexcept {
+      return timeout_;
+    }
+
+    /*every entry we've applied, in order, including those that came in a snapshot*/
+    std::vector<std::vector<std::byte>> const& applied() const noexcept {
+      return applied_;
+    }
+
+    uint64_t flushes() const noexcept {
+      return flushes_;
+    }
+
+    /*called on every flush, to stand in for making things durable*/
+    void onFlush(std::function<void()> flushed) {
+      onFlush_ = std::move(flushed);
+    }
+
+    /*entries still in the log, rather than only in the snapshot*/
+    size_t logEntries() const noexcept {
+      return log_.size();
+    }
+  private:
+    struct Stored_data {
+      std::vector<std::byte> bytes;
+      Array_view<std::byte> view;
+    };
+
+    struct Stored {
+      Term term;
+      std::shared_ptr<Array_view<std::byte>> view;
+    };
+
+    static std::shared_ptr<Array_view<std::byte>> store_(Array_view<std::byte> data) {
+      auto stored = std::make_shared<Stored_data>();
+      stored->bytes.assign(data.begin(), data.end());
+      stored->view = Array_view<std::byte>{ stored->bytes };
+      return std::shared_ptr<Array_view<std::byte>>{ stored, &stored->view };
+    }
+
+    /*each entry's size in 8 bytes, then the entry*/
+    static std::vector<std::byte> encode_(std::vector<std::vector<std::byte>> const& entries) {
+      std::vector<std::byte> encoded;
+      for (auto const& entry : entries) {
+        const uint64_t size = entry.size();
+        for (size_t i = 0; i < sizeof(size); ++i) {
+          encoded.push_back(static_cast<std::byte>((size >> (8 * i)) & 0xff));
+        }
+        encoded.insert(encoded.end(), entry.begin(), entry.end());
+      }
+      return encoded;
+    }
+
+    static std::vector<std::vector<std::byte>> decode_(std::vector<std::byte> const& encoded) {
+      std::vector<std::vector<std::byte>> entries;
+      for (size_t at = 0; at + sizeof(uint64_t) <= encoded.size();) {
+        uint64_t size = 0;
+        for (size_t i = 0; i < sizeof(size); ++i) {
+          size |= static_cast<uint64_t>(encoded[at + i]) << (8 * i);
+        }
+        at += sizeof(size);
+        entries.emplace_back(encoded.begin() + static_cast<ptrdiff_t>(at), encoded.begin() + static_cast<ptrdiff_t>(at + size));
+        at += size;
+      }
+      return entries;
+    }
+
+    MemoryCluster* cluster_;
+    NodeId me_;
+    Term currentTerm_ = 0;
+    Vote votedFor_{ 0, 0 };
+    Index committed_ = 0;
+    //entries after the snapshot
+    std::vector<Stored> log_;
+    EntryInfo snapshotInfo_{ 0, 0 };
+    std::shared_ptr<Array_view<std::byte>> snapshot_;
+    std::vector<std::byte> receiving_;
+    std::vector<std::vector<std::byte>> applied_;
+    std::optional<TimeoutToken> timeout_;
+    uint64_t flushes_ = 0;
+    std::function<void()> onFlush_;
+  };
+
+  class MemoryCluster {
+  public:
+    using Node = Raft<MemoryDriver>;
+
+    /*nodes get ids 1 to size, and start off as followers*/
+    explicit MemoryCluster(size_t size, ReplicationOptions replication = ReplicationOptions{}) {
+      for (NodeId id = 1; id <= size; ++id) {
+        std::vector<NodeId> peers;
+        for (NodeId peer = 1; peer <= size; ++peer) {
+          if (peer != id) {
+            peers.push_back(peer);
+          }
+        }
+        nodes_.push_back(std::make_unique<Node>(id, std::move(peers), MemoryDriver{ *this, id }, replication));
+      }
+      for (auto& node : nodes_) {
+        node->start();
+      }
+    }
+    MemoryCluster(MemoryCluster const&) = delete;
+    MemoryCluster& operator=(MemoryCluster const&) = delete;
+
+    size_t size() const noexcept {
+      return nodes_.size();
+    }
+
+    Node& node(NodeId id) noexcept {
+      return *nodes_[id - 1];
+    }
+
+    /*fires id's timeout, false if it had none*/
+    bool fire(NodeId id) noexcept {
+      const auto token = node(id).driver().pendingTimeout();
+      if (!token) {
+        return false;
+      }
+      node(id).timeout(*token);
+      node(id).flush();
+      return true;
+    }
+
+    /*hands over up to most queued messages, oldest first, returns how many*/
+    size_t deliver(size_t most = std::numeric_limits<size_t>::max()) {
+      size_t delivered = 0;
+      for (; delivered < most && !queue_.empty(); ++delivered) {
+        Message message = std::move(queue_.front());
+        queue_.pop_front();
+        if (isolated_(message.from) || isolated_(message.to)) {
+          continue;
+        }
+        std::visit([this, &message](auto& rpc) { node(message.to).recv(message.from, view_(rpc)); }, message.rpc);
+      }
+      for (auto& node : nodes_) {
+        node->flush();
+      }
+      return delivered;
+    }
+
+    /*delivers until nothing is left to deliver*/
+    size_t settle() {
+      size_t delivered = 0;
+      while (!queue_.empty()) {
+        delivered += deliver();
+      }
+      return delivered;
+    }
+
+    /*drops everything sent to or from id, until it's let back*/
+    void isolate(NodeId id, bool isolated = true) {
+      if (isolated_nodes_.size() < nodes_.size() + 1) {
+        isolated_nodes_.resize(nodes_.size() + 1, false);
+      }
+      isolated_nodes_[id] = isolated;
+    }
+
+    /*times id out and lets the election run, returns id if it won, 0 if it didn't*/
+    NodeId elect(NodeId id) {
+      fire(id);
+      settle();
+      return node(id).isLeader() ? id : 0;
+    }
+
+    /*sends the leader's heartbeat round, so followers hear what's committed*/
+    void heartbeat(NodeId leader) {
+      fire(leader);
+      settle();
+    }
+
+    /*the first node that thinks it leads, 0 if nobody does*/
+    NodeId leader() const noexcept {
+      for (auto const& node : nodes_) {
+        if (node->isLeader()) {
+          return node->me();
+        }
+      }
+      return 0;
+    }
+
+    size_t pending() const noexcept {
+      return queue_.size();
+    }
+
+    uint64_t appendEntriesSent() const noexcept {
+      return appendEntriesSent_;
+    }
+
+    uint64_t installSnapshotSent() const noexcept {
+      return installSnapshotSent_;
+    }
+
+    template<typename Rpc>
+    void send(NodeId from, NodeId to, Rpc const& rpc) {
+      queue_.push_back(Message{ from, to, own_(rpc) });
+    }
+  private:
+    /*
+    AppendEntries only views its entries, so we keep a copy until it's
+    delivered. The views point into heap buffers, which stay put when this moves.
+    */
+    struct OwnedAppendEntries {
+      AppendEntries rpc;
+      std::vector<Entry> entries;
+      std::vector<std::vector<std::byte>> data;
+    };
+
+    struct OwnedInstallSnapshot {
+      InstallSnapshot rpc;
+      std::vector<std::byte> data;
+    };
+
+    struct Message {
+      NodeId from;
+      NodeId to;
+      std::variant<OwnedAppendEntries, AppendEntriesReply, OwnedInstallSnapshot, InstallSnapshotReply, RequestVote, RequestVoteReply> rpc;
+    };
+
+    template<typename Rpc>
+    static Rpc own_(Rpc const& rpc) {
+      return rpc;
+    }
+
+    OwnedAppendEntries own_(AppendEntries const& rpc) {
+      ++appendEntriesSent_;
+      OwnedAppendEntries owned{ rpc, {}, {} };
+      for (Entry const& entry : rpc.entries) {
+        owned.data.emplace_back(entry.data.begin(), entry.data.end());
+      }
+      for (size_t i = 0; i < owned.data.size(); ++i) {
+        owned.entries.push_back(Entry{ rpc.entries[i].term, Array_view<std::byte>{ owned.data[i] } });
+      }
+      owned.rpc.entries = Array_view<Entry>{ owned.entries };
+      return owned;
+    }
+
+    OwnedInstallSnapshot own_(InstallSnapshot const& rpc) {
+      ++installSnapshotSent_;
+      OwnedInstallSnapshot owned{ rpc, std::vector<std::byte>(rpc.data.begin(), rpc.data.end()) };
+      owned.rpc.data = Array_view<std::byte>{ owned.data };
+      return owned;
+    }
+
+    template<typename Rpc>
+    static Rpc const& view_(Rpc const& rpc) {
+      return rpc;
+    }
+
+    static AppendEntries const& view_(OwnedAppendEntries const& owned) {
+      return owned.rpc;
+    }
+
+    static InstallSnapshot const& view_(OwnedInstallSnapshot const& owned) {
+      return owned.rpc;
+    }
+
+    bool isolated_(NodeId id) const noexcept {
+      return id < isolated_nodes_.size() && isolated_nodes_[id];
+    }
+
+    std::vector<std::unique_ptr<Node>> nodes_;
+    std::deque<Message> queue_;
+    std::vector<bool> isolated_nodes_;
+    uint64_t appendEntriesSent_ = 0;
+    uint64_t installSnapshotSent_ = 0;
+  };
+
+  template<typename Rpc>
+  void MemoryDriver::send(NodeId who, Rpc const& rpc) {
+    cluster_->send(me_, who, rpc);
+  }
+}
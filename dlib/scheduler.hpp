@@ -0,0 +1,417 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+#include <dlib/concurrency.hpp>
+
+/*
+A work-stealing thread pool, and Work_stealing_concurrency, a concurrency
+policy whose spawn and parallel_for run on it.
+
+Every worker has its own Chase-Lev deque. A worker pushes and pops the
+bottom of its own deque without contention, idle workers steal from the
+top of someone else's. Tasks spawned from outside the pool go on a shared
+locked queue. Waiting on a Task_group runs other tasks until the group is
+done, so waiting from inside a task can't starve the pool.
+*/
+
+namespace dlib {
+  namespace scheduler_impl {
+    /*
+    Chase-Lev deque of pointers (Le et al, "Correct and Efficient
+    Work-Stealing for Weak Memory Models"). The owner pushes and pops at the
+    bottom, anyone can steal from the top. Null means empty, so null can't
+    be pushed. Outgrown rings are kept until we go, a thief may still be
+    reading one.
+    */
+    template<typename T>
+    class Work_deque {
+    public:
+      static_assert(std::is_pointer_v<T>, "work deques hold pointers, null meaning empty");
+
+      explicit Work_deque(size_t capacity = 256) {
+        size_t rounded = 1;
+        while (rounded < capacity) {
+          rounded <<= 1;
+        }
+        rings_.push_back(std::make_unique<Ring>(rounded));
+        ring_.store(rings_.back().get(), std::memory_order_relaxed);
+      }
+      Work_deque(Work_deque const&) = delete;
+      Work_deque& operator=(Work_deque const&) = delete;
+
+      /*owner only*/
+      void push(T value) {
+        const int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        const int64_t top = top_.load(std::memory_order_acquire);
+        Ring* ring = ring_.load(std::memory_order_relaxed);
+        if (bottom - top > static_cast<int64_t>(ring->mask)) {
+          ring = grow_(ring, top, bottom);
+        }
+        ring->put(bottom, value);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+      }
+
+      /*owner only, the most recently pushed*/
+      T pop() noexcept {
+        const int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        Ring* ring = ring_.load(std::memory_order_relaxed);
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = top_.load(std::memory_order_relaxed);
+        if (top > bottom) {
+          bottom_.store(bottom + 1, std::memory_order_relaxed);
+          return nullptr;
+        }
+        T value = ring->get(bottom);
+        if (top == bottom) {
+          //the last one, a thief may be after it too
+          if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            value = nullptr;
+          }
+          bottom_.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return value;
+      }
+
+      /*anyone, the least recently pushed*/
+      T steal() noexcept {
+        int64_t top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t bottom = bottom_.load(std::memory_order_acquire);
+        if (top >= bottom) {
+          return nullptr;
+        }
+        Ring* ring = ring_.load(std::memory_order_acquire);
+        T value = ring->get(top);
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+          return nullptr;
+        }
+        return value;
+      }
+
+      /*a guess, it can be stale by the time it's read*/
+      bool empty() const noexcept {
+        return top_.load(std::memory_order_relaxed) >= bottom_.load(std::memory_order_relaxed);
+      }
+    private:
+      struct Ring {
+        explicit Ring(size_t capacity) :
+          mask{ capacity - 1 },
+          slots{ std::make_unique<std::atomic<T>[]>(capacity) } {
+
+        }
+
+        T get(int64_t index) const noexcept {
+          return slots[static_cast<size_t>(index) & mask].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t index, T value) noexcept {
+          slots[static_cast<size_t>(index) & mask].store(value, std::memory_order_relaxed);
+        }
+
+        size_t mask;
+        std::unique_ptr<std::atomic<T>[]> slots;
+      };
+
+      Ring* grow_(Ring* ring, int64_t top, int64_t bottom) {
+        rings_.push_back(std::make_unique<Ring>((ring->mask + 1) * 2));
+        Ring* grown = rings_.back().get();
+        for (int64_t i = top; i < bottom; ++i) {
+          grown->put(i, ring->get(i));
+        }
+        ring_.store(grown, std::memory_order_release);
+        return grown;
+      }
+
+      alignas(cache_line_size) std::atomic<int64_t> top_{ 0 };
+      alignas(cache_line_size) std::atomic<int64_t> bottom_{ 0 };
+      std::atomic<Ring*> ring_{ nullptr };
+      //only the owner touches this
+      std::vector<std::unique_ptr<Ring>> rings_;
+    };
+  }
+
+  class Scheduler {
+  public:
+    /*Tasks spawned into a group can be waited on together*/
+    class Task_group {
+    public:
+      Task_group() = default;
+      Task_group(Task_group const&) = delete;
+      Task_group& operator=(Task_group const&) = delete;
+
+      /*a guess, unless nothing can spawn into us any more*/
+      bool done() const noexcept {
+        return left_.load(std::memory_order_acquire) == 0;
+      }
+    private:
+      friend class Scheduler;
+
+      std::atomic<size_t> left_{ 0 };
+    };
+
+    explicit Scheduler(size_t workers = std::max<size_t>(1, std::thread::hardware_concurrency())) {
+      workers_.reserve(workers);
+      for (size_t i = 0; i < workers; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+      }
+      //all the deques exist before anyone can steal from them
+      for (size_t i = 0; i < workers; ++i) {
+        workers_[i]->thread = std::thread{ [this, i]() { work_(i); } };
+      }
+    }
+    Scheduler(Scheduler const&) = delete;
+    Scheduler& operator=(Scheduler const&) = delete;
+
+    /*runs whatever was already spawned, then stops the workers*/
+    ~Scheduler() noexcept {
+      {
+        std::lock_guard lock{ sleep_mutex_ };
+        stopping_ = true;
+      }
+      wake_.notify_all();
+      for (auto& worker : workers_) {
+        worker->thread.join();
+      }
+    }
+
+    template<typename F>
+    void spawn(F&& f) {
+      push_(new Task{ std::function<void()>{ std::forward<F>(f) }, nullptr });
+    }
+
+    template<typename F>
+    void spawn(Task_group& group, F&& f) {
+      group.left_.fetch_add(1, std::memory_order_relaxed);
+      push_(new Task{ std::function<void()>{ std::forward<F>(f) }, &group });
+    }
+
+    /*
+    Runs other tasks until everything spawned into group is done. With
+    nothing to run, what's left is running elsewhere (maybe blocked), so
+    after a few tries we sleep till there's work again or the group's done.
+    */
+    void wait(Task_group& group) noexcept {
+      const size_t self = my_index_();
+      size_t missed = 0;
+      while (!group.done()) {
+        if (run_one_(self)) {
+          missed = 0;
+        } else if (++missed < tries_before_sleeping_) {
+          std::this_thread::yield();
+        } else {
+          std::unique_lock lock{ sleep_mutex_ };
+          //pairs with the group's last task checking sleepers_ in run_one_, and with push_
+          sleepers_.fetch_add(1, std::memory_order_seq_cst);
+          wake_.wait(lock, [this, &group]() {
+            return group.left_.load(std::memory_order_seq_cst) == 0 || pending_.load(std::memory_order_seq_cst) > 0;
+          });
+          sleepers_.fetch_sub(1, std::memory_order_relaxed);
+          missed = 0;
+        }
+      }
+    }
+
+    /*
+    f(i) for every i in [begin, end), split into chunks of at least grain
+    over the workers. The calling thread runs a chunk too, and returns
+    once they've all run.
+    */
+    template<typename Index, typename F>
+    void parallel_for(Index begin, Index end, F&& f, Index grain = 1) {
+      if (begin >= end) {
+        return;
+      }
+      const size_t count = static_cast<size_t>(end - begin);
+      //a few chunks per worker, so the stealing can even out uneven chunks
+      const size_t chunk = std::max<size_t>(static_cast<size_t>(std::max<Index>(grain, 1)), count / (workers_.size() * 4) + 1);
+      Task_group group;
+      Index on = begin;
+      while (static_cast<size_t>(end - on) > chunk) {
+        const Index chunk_end = on + static_cast<Index>(chunk);
+        spawn(group, [on, chunk_end, &f]() {
+          for (Index i = on; i < chunk_end; ++i) {
+            f(i);
+          }
+        });
+        on = chunk_end;
+      }
+      for (Index i = on; i < end; ++i) {
+        f(i);
+      }
+      wait(group);
+    }
+
+    size_t workers() const noexcept {
+      return workers_.size();
+    }
+
+    /*one for the whole process, with a worker per hardware thread*/
+    static Scheduler& shared() {
+      static Scheduler scheduler;
+      return scheduler;
+    }
+  private:
+    struct Task {
+      std::function<void()> run;
+      Task_group* group;
+    };
+
+    struct alignas(cache_line_size) Worker {
+      scheduler_impl::Work_deque<Task*> deque;
+      std::thread thread;
+    };
+
+    static constexpr size_t not_a_worker_ = static_cast<size_t>(-1);
+    //empty handed rounds wait makes before it sleeps
+    static constexpr size_t tries_before_sleeping_ = 16;
+
+    /*which of our workers the calling thread is, if any*/
+    size_t my_index_() const noexcept {
+      return current_scheduler_ == this ? current_index_ : not_a_worker_;
+    }
+
+    void push_(Task* task) {
+      const size_t self = my_index_();
+      if (self == not_a_worker_) {
+        std::lock_guard lock{ injected_mutex_ };
+        injected_.push_back(task);
+      } else {
+        workers_[self]->deque.push(task);
+      }
+      pending_.fetch_add(1, std::memory_order_seq_cst);
+      //pairs with the sleepers_ increment in work_, one of us sees the other
+      if (sleepers_.load(std::memory_order_seq_cst) > 0) {
+        { std::lock_guard lock{ sleep_mutex_ }; }
+        wake_.notify_one();
+      }
+    }
+
+    Task* find_(size_t self) noexcept {
+      Task* task = nullptr;
+      if (self != not_a_worker_) {
+        task = workers_[self]->deque.pop();
+      }
+      if (task == nullptr) {
+        task = steal_(self);
+      }
+      if (task == nullptr) {
+        std::lock_guard lock{ injected_mutex_ };
+        if (!injected_.empty()) {
+          task = injected_.front();
+          injected_.pop_front();
+        }
+      }
+      if (task != nullptr) {
+        pending_.fetch_sub(1, std::memory_order_relaxed);
+      }
+      return task;
+    }
+
+    Task* steal_(size_t self) noexcept {
+      const size_t count = workers_.size();
+      //start somewhere different each time, so thieves spread out
+      thread_local size_t seed = std::hash<std::thread::id>{}(std::this_thread::get_id());
+      seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+      const size_t start = static_cast<size_t>(seed >> 33) % count;
+      for (size_t i = 0; i < count; ++i) {
+        const size_t victim = (start + i) % count;
+        if (victim == self) {
+          continue;
+        }
+        Task* task = workers_[victim]->deque.steal();
+        if (task != nullptr) {
+          return task;
+        }
+      }
+      return nullptr;
+    }
+
+    bool run_one_(size_t self) noexcept {
+      Task* task = find_(self);
+      if (task == nullptr) {
+        return false;
+      }
+      task->run();
+      //the group can be gone once it's done, so after this only our own members are touched
+      if (task->group != nullptr
+        && task->group->left_.fetch_sub(1, std::memory_order_seq_cst) == 1
+        && sleepers_.load(std::memory_order_seq_cst) > 0) {
+        //someone may be asleep in wait on it
+        { std::lock_guard lock{ sleep_mutex_ }; }
+        wake_.notify_all();
+      }
+      delete task;
+      return true;
+    }
+
+    void work_(size_t index) noexcept {
+      current_scheduler_ = this;
+      current_index_ = index;
+      for (;;) {
+        if (run_one_(index)) {
+          continue;
+        }
+        std::unique_lock lock{ sleep_mutex_ };
+        sleepers_.fetch_add(1, std::memory_order_seq_cst);
+        wake_.wait(lock, [this]() { return stopping_ || pending_.load(std::memory_order_seq_cst) > 0; });
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+        if (stopping_ && pending_.load(std::memory_order_seq_cst) == 0) {
+          return;
+        }
+      }
+    }
+
+    static inline thread_local const Scheduler* current_scheduler_ = nullptr;
+    static inline thread_local size_t current_index_ = not_a_worker_;
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::mutex injected_mutex_;
+    std::deque<Task*> injected_;
+    //spawned and not yet picked up
+    std::atomic<size_t> pending_{ 0 };
+    std::atomic<size_t> sleepers_{ 0 };
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+  };
+
+  /*Std_concurrency's locks and atomics, with spawn and parallel_for on the shared Scheduler*/
+  struct Work_stealing_concurrency :
+    public Std_concurrency {
+    using Task_group = Scheduler::Task_group;
+
+    /*the scheduler waits for f before the process exits, not whoever spawned it*/
+    template<typename F>
+    static void spawn(F&& f) {
+      Scheduler::shared().spawn(std::forward<F>(f));
+    }
+
+    template<typename F>
+    static void spawn(Task_group& group, F&& f) {
+      Scheduler::shared().spawn(group, std::forward<F>(f));
+    }
+
+    static void wait(Task_group& group) noexcept {
+      Scheduler::shared().wait(group);
+    }
+
+    template<typename Index, typename F>
+    static void parallel_for(Index begin, Index end, F&& f) {
+      Scheduler::shared().parallel_for(begin, end, std::forward<F>(f));
+    }
+  };
+}
@@ -0,0 +1,387 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <memory>
+#include <vector>
+#include <array>
+#include <mutex>
+#include <utility>
+#include <algorithm>
+#include <memory_resource>
+
+#include <dlib/args.hpp>
+#include <dlib/concurrency.hpp>
+#include <dlib/outcome.hpp>
+#include <dlib/pointer_to.hpp>
+
+/*
+Raw storage carved out of large chunks, for when Pool's recycling of
+constructed values isn't what's wanted.
+
+Slab hands out storage for one Type at a time, and make() constructs into
+it, returning a Slab_pointer that destroys and gives the storage back.
+Arena hands out any size, and Arena_resource/Arena_allocator let standard
+containers (std::pmr::vector, Unordered_vector<T, std::pmr::vector>) use it.
+
+Chunks are only freed when the slab or arena goes, so anything handed out
+must be given back (or abandoned) before then.
+*/
+
+namespace dlib {
+  /*How many bytes a slab or arena asks for at a time*/
+  template<size_t>
+  struct Chunk_size_is {};
+
+  template<typename Slab>
+  class Return_to_slab_destroyer {
+  public:
+    using Slab_pointer = typename Slab::Pointer_to;
+    using Slab_type = typename Slab::Type;
+
+    Return_to_slab_destroyer(Slab_pointer slab) noexcept :
+      slab_(std::move(slab)) {
+
+    }
+
+    void operator()(Slab_type* type) const noexcept {
+      type->~Slab_type();
+      slab_->deallocate(type);
+    }
+  private:
+    Slab_pointer slab_;
+  };
+
+  template<typename Slab>
+  using Slab_pointer = std::unique_ptr<typename Slab::Type, Return_to_slab_destroyer<Slab>>;
+
+  namespace slab_impl {
+    /*chunks are page aligned, so any block up to a page gets its natural alignment*/
+    constexpr size_t chunk_alignment = 4096;
+
+    class Chunks {
+    public:
+      Chunks() = default;
+      Chunks(Chunks const&) = delete;
+      Chunks& operator=(Chunks const&) = delete;
+      ~Chunks() noexcept {
+        for (std::byte* chunk : chunks_) {
+          ::operator delete(chunk, std::align_val_t{ chunk_alignment });
+        }
+      }
+
+      std::byte* allocate(size_t size) noexcept {
+        auto* chunk = static_cast<std::byte*>(::operator new(size, std::align_val_t{ chunk_alignment }, std::nothrow));
+        if (chunk != nullptr) {
+          chunks_.push_back(chunk);
+        }
+        return chunk;
+      }
+
+      size_t count() const noexcept {
+        return chunks_.size();
+      }
+    private:
+      std::vector<std::byte*> chunks_;
+    };
+
+    template<typename Type_, typename Concurrency_, typename Pointer_, size_t chunk_size_>
+    class Slab :
+      public Get_pointer_from<Pointer_> {
+    public:
+      using Type = Type_;
+      using Concurrency_arg = Concurrency_;
+      using Pointer_arg = Pointer_;
+      using Pointer_to = Get_pointer_to<Pointer_arg, Slab>;
+      using Holder = Get_holder<Pointer_arg, Slab>;
+      using Pointer = Slab_pointer<Slab>;
+
+      static constexpr size_t chunk_size = chunk_size_;
+
+      Slab() = default;
+      Slab(Slab const&) = delete;
+      Slab& operator=(Slab const&) = delete;
+
+      /*uninitialized storage for a Type, null if we're out of memory*/
+      Type* allocate() noexcept {
+        std::lock_guard lock{ mutex_ };
+        if (free_ != nullptr) {
+          Slot* slot = free_;
+          free_ = slot->next;
+          return reinterpret_cast<Type*>(slot->storage);
+        }
+        if (bump_ == bump_end_) {
+          std::byte* chunk = chunks_.allocate(slots_per_chunk_ * sizeof(Slot));
+          if (chunk == nullptr) {
+            return nullptr;
+          }
+          bump_ = reinterpret_cast<Slot*>(chunk);
+          bump_end_ = bump_ + slots_per_chunk_;
+        }
+        return reinterpret_cast<Type*>((bump_++)->storage);
+      }
+
+      /*hands back storage from allocate, whatever was in it must already be destroyed*/
+      void deallocate(Type* type) noexcept {
+        Slot* slot = reinterpret_cast<Slot*>(type);
+        std::lock_guard lock{ mutex_ };
+        slot->next = free_;
+        free_ = slot;
+      }
+
+      /*constructs a Type in our storage, it goes back to us when the pointer does*/
+      template<typename ...Args>
+      Result<Pointer> make(Args&&... args) {
+        Type* storage = allocate();
+        if (storage == nullptr) {
+          return error("out of memory");
+        }
+        Type* made;
+        try {
+          made = new (storage) Type(std::forward<Args>(args)...);
+        } catch (...) {
+          //nothing was made, so the storage is still ours to give back
+          deallocate(storage);
+          throw;
+        }
+        return Pointer{ made, Return_to_slab_destroyer<Slab>{ this->get_pointer_to(this) } };
+      }
+
+      /*bytes we've taken from the system*/
+      size_t reserved() const noexcept {
+        std::lock_guard lock{ mutex_ };
+        return chunks_.count() * slots_per_chunk_ * sizeof(Slot);
+      }
+    private:
+      union Slot {
+        Slot* next;
+        alignas(Type) std::byte storage[sizeof(Type)];
+      };
+
+      static constexpr size_t slots_per_chunk_ = std::max<size_t>(1, chunk_size / sizeof(Slot));
+
+      mutable Mutex<Concurrency_arg> mutex_;
+      Chunks chunks_;
+      Slot* free_ = nullptr;
+      Slot* bump_ = nullptr;
+      Slot* bump_end_ = nullptr;
+    };
+
+    /*
+    Power of two size classes from 16 bytes to a quarter of a chunk, each
+    with its own free list, bump allocated out of shared chunks. Anything
+    bigger goes straight to operator new.
+    */
+    template<typename Concurrency_, typename Pointer_, size_t chunk_size_>
+    class Arena :
+      public Get_pointer_from<Pointer_> {
+    public:
+      using Concurrency_arg = Concurrency_;
+      using Pointer_arg = Pointer_;
+      using Pointer_to = Get_pointer_to<Pointer_arg, Arena>;
+      using Holder = Get_holder<Pointer_arg, Arena>;
+
+      static constexpr size_t chunk_size = chunk_size_;
+      static constexpr size_t min_block = 16;
+      static constexpr size_t max_block = chunk_size / 4;
+      static_assert(max_block >= min_block, "chunks are too small to carve up");
+
+      Arena() = default;
+      Arena(Arena const&) = delete;
+      Arena& operator=(Arena const&) = delete;
+
+      /*null if we're out of memory*/
+      void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) noexcept {
+        const size_t block = block_size_(bytes, alignment);
+        if (block > max_block || alignment > chunk_alignment) {
+          return ::operator new(bytes, std::align_val_t{ alignment }, std::nothrow);
+        }
+
+        std::lock_guard lock{ mutex_ };
+        Free*& free = free_[class_(block)];
+        if (free != nullptr) {
+          Free* taking = free;
+          free = taking->next;
+          in_use_ += block;
+          return taking;
+        }
+
+        //blocks are aligned to their size, which covers any alignment they were asked for
+        std::byte* start = align_up_(bump_, block);
+        if (bump_ == nullptr || start + block > bump_end_) {
+          std::byte* chunk = chunks_.allocate(chunk_size);
+          if (chunk == nullptr) {
+            return nullptr;
+          }
+          start = chunk;
+          bump_end_ = chunk + chunk_size;
+        }
+        bump_ = start + block;
+        in_use_ += block;
+        return start;
+      }
+
+      /*bytes and alignment must be what p was allocated with*/
+      void deallocate(void* p, size_t bytes, size_t alignment = alignof(std::max_align_t)) noexcept {
+        const size_t block = block_size_(bytes, alignment);
+        if (block > max_block || alignment > chunk_alignment) {
+          ::operator delete(p, std::align_val_t{ alignment });
+          return;
+        }
+
+        std::lock_guard lock{ mutex_ };
+        Free* freeing = static_cast<Free*>(p);
+        Free*& free = free_[class_(block)];
+        freeing->next = free;
+        free = freeing;
+        in_use_ -= block;
+      }
+
+      /*bytes we've taken from the system, not counting anything too big to carve*/
+      size_t reserved() const noexcept {
+        std::lock_guard lock{ mutex_ };
+        return chunks_.count() * chunk_size;
+      }
+
+      /*bytes handed out and not yet given back, rounded up to their size class*/
+      size_t in_use() const noexcept {
+        std::lock_guard lock{ mutex_ };
+        return in_use_;
+      }
+    private:
+      struct Free {
+        Free* next;
+      };
+
+      static constexpr size_t class_count_() noexcept {
+        size_t count = 0;
+        for (size_t block = min_block; block <= max_block; block <<= 1) {
+          ++count;
+        }
+        return count;
+      }
+
+      static size_t block_size_(size_t bytes, size_t alignment) noexcept {
+        size_t block = min_block;
+        const size_t wanted = std::max(bytes, alignment);
+        if (wanted > max_block) {
+          //too big to carve, and doubling up to it could wrap around
+          return wanted;
+        }
+        while (block < wanted) {
+          block <<= 1;
+        }
+        return block;
+      }
+
+      static size_t class_(size_t block) noexcept {
+        size_t index = 0;
+        for (size_t on = min_block; on < block; on <<= 1) {
+          ++index;
+        }
+        return index;
+      }
+
+      static std::byte* align_up_(std::byte* p, size_t alignment) noexcept {
+        const auto address = reinterpret_cast<uintptr_t>(p);
+        return reinterpret_cast<std::byte*>((address + alignment - 1) & ~(alignment - 1));
+      }
+
+      mutable Mutex<Concurrency_arg> mutex_;
+      Chunks chunks_;
+      std::array<Free*, class_count_()> free_{};
+      std::byte* bump_ = nullptr;
+      std::byte* bump_end_ = nullptr;
+      size_t in_use_ = 0;
+    };
+  }
+
+  template<typename Type, typename ...Args>
+  using Slab = slab_impl::Slab<Type,
+    First<Get_arg_defaulted<Concurrency_is, List<Std_concurrency>, Args...>>,
+    First<Get_arg_defaulted<Pointer_is, List<Raw_pointer>, Args...>>,
+    value_arg_defaulted<size_t, Chunk_size_is, 64 * 1024, Args...>>;
+
+  template<typename ...Args>
+  using Arena = slab_impl::Arena<
+    First<Get_arg_defaulted<Concurrency_is, List<Std_concurrency>, Args...>>,
+    First<Get_arg_defaulted<Pointer_is, List<Raw_pointer>, Args...>>,
+    value_arg_defaulted<size_t, Chunk_size_is, 64 * 1024, Args...>>;
+
+  /*An arena as a std::pmr::memory_resource, the arena has to outlive it*/
+  template<typename Arena>
+  class Arena_resource final :
+    public std::pmr::memory_resource {
+  public:
+    explicit Arena_resource(Arena& arena) noexcept :
+      arena_{ &arena } {
+
+    }
+  private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+      void* allocated = arena_->allocate(bytes, alignment);
+      if (allocated == nullptr) {
+        throw std::bad_alloc{};
+      }
+      return allocated;
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+      arena_->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override {
+      const auto* resource = dynamic_cast<const Arena_resource*>(&other);
+      return resource != nullptr && resource->arena_ == arena_;
+    }
+
+    Arena* arena_;
+  };
+
+  /*An arena as a standard allocator, the arena has to outlive it*/
+  template<typename T, typename Arena>
+  class Arena_allocator {
+  public:
+    using value_type = T;
+
+    explicit Arena_allocator(Arena& arena) noexcept :
+      arena_{ &arena } {
+
+    }
+
+    template<typename U>
+    Arena_allocator(Arena_allocator<U, Arena> const& other) noexcept :
+      arena_{ other.arena() } {
+
+    }
+
+    T* allocate(size_t n) {
+      void* allocated = arena_->allocate(n * sizeof(T), alignof(T));
+      if (allocated == nullptr) {
+        throw std::bad_alloc{};
+      }
+      return static_cast<T*>(allocated);
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+      arena_->deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    Arena* arena() const noexcept {
+      return arena_;
+    }
+
+    template<typename U>
+    bool operator==(Arena_allocator<U, Arena> const& other) const noexcept {
+      return arena_ == other.arena();
+    }
+
+    template<typename U>
+    bool operator!=(Arena_allocator<U, Arena> const& other) const noexcept {
+      return arena_ != other.arena();
+    }
+  private:
+    Arena* arena_;
+  };
+}
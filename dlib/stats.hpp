@@ -0,0 +1,205 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <functional>
+
+#include <dlib/concurrency.hpp>
+
+/*
+Statistics policies for containers (see Cache).
+
+A policy is a type with a nested template:
+
+  template<typename Concurrency>
+  class Type {
+    static constexpr bool enabled;            //false if the container can skip timing entirely
+    class Source {                            //one per backing source
+      void fetched(bool found, uint64_t ns);  //a get for one key took ns
+      Source_stats load() const;
+    };
+    void lock_waited(uint64_t ns);            //a lock was contended, and took ns to get
+    Lock_stats load() const;
+  };
+
+Counters are striped over a few cache lines, a thread always adds to the
+same stripe, and reads add the stripes up. So counting costs a relaxed add
+on a line other threads rarely touch.
+*/
+
+namespace dlib {
+  template<typename>
+  struct Stats_is;
+
+  /*
+  Counts by power of two, bucket i holds values in [2^i, 2^(i+1)),
+  bucket 0 also holds 0.
+  */
+  struct Log2_histogram {
+    static constexpr size_t bucket_count = 64;
+
+    static constexpr size_t bucket(uint64_t value) noexcept {
+      size_t index = 0;
+      while (value > 1) {
+        value >>= 1;
+        ++index;
+      }
+      return index;
+    }
+
+    uint64_t count() const noexcept {
+      uint64_t total = 0;
+      for (uint64_t in_bucket : buckets) {
+        total += in_bucket;
+      }
+      return total;
+    }
+
+    /*an upper bound of the q quantile (0 <= q <= 1), 0 if empty*/
+    uint64_t quantile(double q) const noexcept {
+      const uint64_t total = count();
+      if (total == 0) {
+        return 0;
+      }
+      const uint64_t wanted = static_cast<uint64_t>(q * static_cast<double>(total - 1)) + 1;
+      uint64_t seen = 0;
+      for (size_t i = 0; i < bucket_count; ++i) {
+        seen += buckets[i];
+        if (seen >= wanted) {
+          return i + 1 == bucket_count ? UINT64_MAX : (uint64_t{ 1 } << (i + 1)) - 1;
+        }
+      }
+      return UINT64_MAX;
+    }
+
+    std::array<uint64_t, bucket_count> buckets{};
+  };
+
+  struct Source_stats {
+    uint64_t found;
+    uint64_t missing;
+    //how long gets took, in nanoseconds
+    Log2_histogram latency;
+  };
+
+  struct Lock_stats {
+    //how often a lock was already taken when we wanted it
+    uint64_t contended;
+    uint64_t waited_ns;
+  };
+
+  namespace stats_impl {
+    constexpr size_t stripes = 8;
+
+    /*which stripe this thread adds to, fixed for the thread's life*/
+    inline size_t stripe() noexcept {
+      static thread_local const size_t mine = std::hash<std::thread::id>{}(std::this_thread::get_id()) % stripes;
+      return mine;
+    }
+
+    template<size_t n>
+    class Striped_counters {
+    public:
+      void add(size_t counter, uint64_t amount) noexcept {
+        stripes_[stripe()].counters[counter].fetch_add(amount, std::memory_order_relaxed);
+      }
+
+      uint64_t load(size_t counter) const noexcept {
+        uint64_t total = 0;
+        for (auto const& on : stripes_) {
+          total += on.counters[counter].load(std::memory_order_relaxed);
+        }
+        return total;
+      }
+    private:
+      struct alignas(cache_line_size) Stripe {
+        std::array<std::atomic<uint64_t>, n> counters{};
+      };
+
+      std::array<Stripe, stripes> stripes_;
+    };
+  }
+
+  /*Counts nothing, and the container never reads the clock for it*/
+  struct No_stats {
+    template<typename Concurrency>
+    class Type {
+    public:
+      static constexpr bool enabled = false;
+
+      class Source {
+      public:
+        void fetched(bool, uint64_t) noexcept {
+
+        }
+
+        Source_stats load() const noexcept {
+          return Source_stats{ 0, 0, {} };
+        }
+      };
+
+      void lock_waited(uint64_t) noexcept {
+
+      }
+
+      Lock_stats load() const noexcept {
+        return Lock_stats{ 0, 0 };
+      }
+    };
+  };
+
+  /*Relaxed counters striped per thread, only under a concurrency policy with threads*/
+  struct Striped_stats {
+    template<typename Concurrency>
+    class Type {
+    public:
+      static constexpr bool enabled = true;
+
+      class Source {
+      public:
+        void fetched(bool found, uint64_t ns) noexcept {
+          counters_.add(found ? found_ : missing_, 1);
+          counters_.add(latency_ + Log2_histogram::bucket(ns), 1);
+        }
+
+        Source_stats load() const noexcept {
+          Source_stats stats{ counters_.load(found_), counters_.load(missing_), {} };
+          for (size_t i = 0; i < Log2_histogram::bucket_count; ++i) {
+            stats.latency.buckets[i] = counters_.load(latency_ + i);
+          }
+          return stats;
+        }
+      private:
+        static constexpr size_t found_ = 0;
+        static constexpr size_t missing_ = 1;
+        static constexpr size_t latency_ = 2;
+
+        stats_impl::Striped_counters<latency_ + Log2_histogram::bucket_count> counters_;
+      };
+
+      void lock_waited(uint64_t ns) noexcept {
+        counters_.add(contended_, 1);
+        counters_.add(waited_ns_, ns);
+      }
+
+      Lock_stats load() const noexcept {
+        return Lock_stats{ counters_.load(contended_), counters_.load(waited_ns_) };
+      }
+    private:
+      static constexpr size_t contended_ = 0;
+      static constexpr size_t waited_ns_ = 1;
+
+      stats_impl::Striped_counters<2> counters_;
+    };
+  };
+
+  /*with one thread there's nothing worth striping, or any lock to wait on*/
+  template<>
+  class Striped_stats::Type<Null_concurrency> :
+    public No_stats::Type<Null_concurrency> {
+
+  };
+}
@@ -0,0 +1 @@
+#include <dlib/db_pool.hpp>
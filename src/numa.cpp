@@ -0,0 +1,120 @@
+#include <dlib/numa.hpp>
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+
+#if __has_include(<sched.h>) && defined(__linux__)
+#include <sched.h>
+#define DLIB_NUMA_LINUX
+#endif
+
+namespace {
+  /*parses the kernel's list format, "0-3,8,10-11"*/
+  std::vector<size_t> parse_list(std::string const& list) noexcept {
+    std::vector<size_t> parsed;
+    size_t on = 0;
+    while (on < list.size()) {
+      size_t end = list.find(',', on);
+      if (end == std::string::npos) {
+        end = list.size();
+      }
+      const std::string range = list.substr(on, end - on);
+      const size_t dash = range.find('-');
+      try {
+        if (dash == std::string::npos) {
+          parsed.push_back(std::stoul(range));
+        } else {
+          const size_t first = std::stoul(range.substr(0, dash));
+          const size_t last = std::stoul(range.substr(dash + 1));
+          for (size_t i = first; i <= last; ++i) {
+            parsed.push_back(i);
+          }
+        }
+      } catch (...) {
+        //blank or garbled, skip it
+      }
+      on = end + 1;
+    }
+    return parsed;
+  }
+
+  std::string read_line(std::string const& path) noexcept {
+    std::ifstream file{ path };
+    std::string line;
+    std::getline(file, line);
+    return line;
+  }
+
+  struct Topology {
+    Topology() noexcept {
+#ifdef DLIB_NUMA_LINUX
+      const std::vector<size_t> online = parse_list(read_line("/sys/devices/system/node/online"));
+      if (online.empty()) {
+        return;
+      }
+      node_count = *std::max_element(online.begin(), online.end()) + 1;
+      node_cpus.resize(node_count);
+      for (size_t node : online) {
+        node_cpus[node] = parse_list(read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+        for (size_t cpu : node_cpus[node]) {
+          if (cpu >= cpu_nodes.size()) {
+            cpu_nodes.resize(cpu + 1, 0);
+          }
+          cpu_nodes[cpu] = node;
+        }
+      }
+#endif
+    }
+
+    size_t node_count = 1;
+    //indexed by cpu, which node it's on
+    std::vector<size_t> cpu_nodes;
+    //indexed by node, which cpus it has
+    std::vector<std::vector<size_t>> node_cpus;
+  };
+
+  Topology const& topology() noexcept {
+    static const Topology topology;
+    return topology;
+  }
+}
+
+size_t dlib::numa_node_count() noexcept {
+  return topology().node_count;
+}
+
+size_t dlib::current_numa_node() noexcept {
+  Topology const& topology = ::topology();
+  if (topology.node_count == 1) {
+    return 0;
+  }
+#ifdef DLIB_NUMA_LINUX
+  //sched_getcpu is a vdso call, cheap enough to ask every time
+  const int cpu = sched_getcpu();
+  if (cpu >= 0 && static_cast<size_t>(cpu) < topology.cpu_nodes.size()) {
+    return topology.cpu_nodes[cpu];
+  }
+#endif
+  return 0;
+}
+
+bool dlib::pin_to_numa_node(size_t node) noexcept {
+  Topology const& topology = ::topology();
+  if (node >= topology.node_cpus.size() || topology.node_cpus[node].empty()) {
+    return false;
+  }
+#ifdef DLIB_NUMA_LINUX
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  for (size_t cpu : topology.node_cpus[node]) {
+    if (cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &cpus);
+    }
+  }
+  return sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+#else
+  return false;
+#endif
+}
@@ -0,0 +1 @@
+#include <dlib/queue.hpp>
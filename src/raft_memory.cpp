@@ -0,0 +1 @@
+#include <dlib/raft_memory.hpp>
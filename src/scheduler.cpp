@@ -0,0 +1 @@
+#include <dlib/scheduler.hpp>
@@ -0,0 +1 @@
+#include <dlib/slab.hpp>
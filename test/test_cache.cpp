@@ -2,8 +2,12 @@
 #include <boost/test/unit_test.hpp>
 
 #include <dlib/cache.hpp>
+#include <dlib/scheduler.hpp>
 #include <unordered_map>
 #include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
 
 namespace {
   template<typename K, typename V>
@@ -17,6 +21,134 @@ namespace {
       }
     }
   };
+
+  /*a slow source that counts how often it gets asked*/
+  struct Slow_source {
+    bool contains(int) const noexcept {
+      return true;
+    }
+    std::atomic<int> gets{ 0 };
+  };
+
+  struct Slow_get {
+    std::optional<std::shared_ptr<const int>> operator()(Slow_source* source, int key) const noexcept {
+      ++source->gets;
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      return std::make_shared<const int>(key);
+    }
+  };
+
+  /*a source that can answer many keys in one go*/
+  struct Batched_source {
+    bool contains(int) const noexcept {
+      return true;
+    }
+    std::optional<std::shared_ptr<const int>> get(int key) noexcept {
+      ++gets;
+      return std::make_shared<const int>(key);
+    }
+    std::vector<std::optional<std::shared_ptr<const int>>> get_many(dlib::Array_view<const int> keys) noexcept {
+      ++batches;
+      asked += keys.size();
+      std::vector<std::optional<std::shared_ptr<const int>>> returning;
+      for (int key : keys) {
+        if (key < 100) {
+          returning.emplace_back(std::make_shared<const int>(key));
+        } else {
+          returning.emplace_back(std::nullopt);
+        }
+      }
+      return returning;
+    }
+    int gets = 0;
+    int batches = 0;
+    size_t asked = 0;
+  };
+
+  /*a clock that only moves when told to*/
+  struct Test_clock {
+    using rep = int64_t;
+    using period = std::milli;
+    using duration = std::chrono::duration<rep, period>;
+    using time_point = std::chrono::time_point<Test_clock>;
+    static constexpr bool is_steady = true;
+
+    static time_point now() noexcept {
+      return time_point{ duration{ ticks.load() } };
+    }
+
+    static inline std::atomic<rep> ticks{ 0 };
+  };
+
+  /*a source whose value for every key goes up each time it's asked*/
+  struct Counting_source {
+    bool contains(int) const noexcept {
+      return true;
+    }
+    std::atomic<int> gets{ 0 };
+  };
+
+  struct Counting_get {
+    std::optional<std::shared_ptr<const int>> operator()(Counting_source* source, int) const noexcept {
+      return std::make_shared<const int>(++source->gets);
+    }
+  };
+
+  /*the first get waits till it's let go, every get answers how many gets there have been*/
+  struct Gated_source {
+    bool contains(int) const noexcept {
+      return true;
+    }
+    std::atomic<int> gets{ 0 };
+    std::atomic<bool> open{ false };
+  };
+
+  struct Gated_get {
+    std::optional<std::shared_ptr<const int>> operator()(Gated_source* source, int) const noexcept {
+      const int got = ++source->gets;
+      if (got == 1) {
+        while (!source->open.load()) {
+          std::this_thread::yield();
+        }
+      }
+      return std::make_shared<const int>(got);
+    }
+  };
+
+  /*a source that notes the most gets it ever had going at once*/
+  struct Overlap_source {
+    bool contains(int) const noexcept {
+      return true;
+    }
+    std::atomic<int> gets{ 0 };
+    std::atomic<int> running{ 0 };
+    std::atomic<int> most{ 0 };
+  };
+
+  struct Overlap_get {
+    std::optional<std::shared_ptr<const int>> operator()(Overlap_source* source, int key) const noexcept {
+      const int now = ++source->running;
+      int most = source->most.load();
+      while (now > most && !source->most.compare_exchange_weak(most, now)) {
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      --source->running;
+      ++source->gets;
+      return std::make_shared<const int>(key);
+    }
+  };
+
+  struct String_size {
+    size_t operator()(std::string const& value) const noexcept {
+      return value.size();
+    }
+  };
+
+  struct Echo_as_shared_ptr {
+    std::optional<std::shared_ptr<const int>> operator()(std::unordered_map<int, int>*, int key) const noexcept {
+      return std::make_shared<const int>(key);
+    }
+  };
 }
 
 BOOST_AUTO_TEST_CASE(cache_string_string_no_source) {
@@ -59,4 +191,615 @@ BOOST_AUTO_TEST_CASE(cache_reads) {
   BOOST_TEST(!cache->shallow_read(0));
   BOOST_TEST(!!cache->read_through(0));
   BOOST_TEST(!!cache->deep_read(0));
-}
\ No newline at end of file
+}
+
+BOOST_AUTO_TEST_CASE(cache_sharded) {
+  using Cache = dlib::Cache<int, int, dlib::Shards_is<8>>;
+  static_assert(Cache::shard_count == 8);
+
+  Cache cache;
+  for (int i = 0; i < 100; ++i) {
+    BOOST_TEST(!!cache.set(i, i * 2));
+  }
+  for (int i = 0; i < 100; ++i) {
+    auto read = cache.shallow_read(i);
+    BOOST_TEST(!!read);
+    BOOST_TEST((*read.value() == i * 2));
+  }
+  cache.flush(5);
+  BOOST_TEST(!cache.shallow_read(5));
+  BOOST_TEST(!!cache.shallow_read(6));
+  cache.flush();
+  BOOST_TEST(!cache.shallow_read(6));
+}
+
+BOOST_AUTO_TEST_CASE(cache_sharded_threads) {
+  using Cache = dlib::Cache<int, int, dlib::Shards_is<16>>;
+  Cache cache;
+  cache.add_source(std::make_shared<std::unordered_map<int, int>>(), dlib::finder_get(Echo_as_shared_ptr{}));
+
+  std::vector<std::thread> threads;
+  std::atomic<bool> all_good{ true };
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&cache, &all_good]() {
+      for (int i = 0; i < 1000; ++i) {
+        auto read = cache.deep_read(i % 64);
+        if (!read || *read.value() != i % 64) {
+          all_good = false;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  BOOST_TEST(all_good.load());
+}
+
+
+BOOST_AUTO_TEST_CASE(cache_snapshot_reads) {
+  using Cache = dlib::Cache<int, int, dlib::Shards_is<4>, dlib::Reads_is<dlib::Snapshot_reads>>;
+  Cache cache;
+  BOOST_TEST(!cache.shallow_read(1));
+  BOOST_TEST(!!cache.set(1, 10));
+  BOOST_TEST((*cache.shallow_read(1).value() == 10));
+  BOOST_TEST(!!cache.set(1, 11));
+  BOOST_TEST((*cache.shallow_read(1).value() == 11));
+  cache.flush(1);
+  BOOST_TEST(!cache.shallow_read(1));
+
+  cache.add_source(std::make_shared<std::unordered_map<int, int>>(), dlib::finder_get(Echo_as_shared_ptr{}));
+  BOOST_TEST(!!cache.deep_read(2));
+  BOOST_TEST((*cache.shallow_read(2).value() == 2));
+  cache.flush();
+  BOOST_TEST(!cache.shallow_read(2));
+}
+
+BOOST_AUTO_TEST_CASE(cache_snapshot_reads_churn) {
+  using Cache = dlib::Cache<int, int, dlib::Reads_is<dlib::Snapshot_reads>>;
+  Cache cache;
+  //enough adds and erases that recent changes get folded into the base many times over
+  for (int i = 0; i < 2000; ++i) {
+    cache.set(i, i);
+  }
+  for (int i = 0; i < 2000; i += 2) {
+    cache.flush(i);
+  }
+  for (int i = 0; i < 2000; i += 4) {
+    cache.set(i, -i);
+  }
+  bool all_good = true;
+  for (int i = 0; i < 2000; ++i) {
+    auto read = cache.shallow_read(i);
+    if (i % 4 == 0) {
+      all_good = all_good && read && *read.value() == -i;
+    } else if (i % 2 == 0) {
+      all_good = all_good && !read;
+    } else {
+      all_good = all_good && read && *read.value() == i;
+    }
+  }
+  BOOST_TEST(all_good);
+}
+
+BOOST_AUTO_TEST_CASE(cache_snapshot_reads_threads) {
+  using Cache = dlib::Cache<int, int, dlib::Reads_is<dlib::Snapshot_reads>>;
+  Cache cache;
+  for (int i = 0; i < 64; ++i) {
+    cache.set(i, i);
+  }
+
+  std::atomic<bool> all_good{ true };
+  std::thread writer{ [&cache]() {
+    for (int i = 0; i < 1000; ++i) {
+      cache.set(i % 64, i % 64);
+    }
+  } };
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 3; ++t) {
+    readers.emplace_back([&cache, &all_good]() {
+      for (int i = 0; i < 1000; ++i) {
+        auto read = cache.shallow_read(i % 64);
+        if (!read || *read.value() != i % 64) {
+          all_good = false;
+        }
+      }
+    });
+  }
+  writer.join();
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  BOOST_TEST(all_good.load());
+}
+
+
+BOOST_AUTO_TEST_CASE(cache_shared_reads_threads) {
+  //clock eviction takes concurrent touches, so hits share the shard lock
+  using Cache = dlib::Cache<int, int, dlib::Eviction_is<dlib::Clock_eviction>, dlib::Concurrency_is<dlib::Spin_concurrency>>;
+  Cache cache{ 48 };
+  for (int i = 0; i < 64; ++i) {
+    cache.set(i, i);
+  }
+
+  std::atomic<bool> all_good{ true };
+  std::thread writer{ [&cache]() {
+    for (int i = 0; i < 1000; ++i) {
+      cache.set(i % 64, i % 64);
+    }
+  } };
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 3; ++t) {
+    readers.emplace_back([&cache, &all_good]() {
+      for (int i = 0; i < 1000; ++i) {
+        //evicted keys miss, but a hit is never the wrong line
+        auto read = cache.shallow_read(i % 64);
+        if (read && *read.value() != i % 64) {
+          all_good = false;
+        }
+      }
+    });
+  }
+  writer.join();
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  BOOST_TEST(all_good.load());
+  const auto counters = cache.counters();
+  BOOST_TEST((counters.hits + counters.misses == 3000));
+  BOOST_TEST((cache.size() <= 48));
+}
+
+BOOST_AUTO_TEST_CASE(cache_lru_eviction) {
+  using Cache = dlib::Cache<int, int, dlib::Eviction_is<dlib::Lru_eviction>>;
+  Cache cache{ 3 };
+  cache.set(1, 1);
+  cache.set(2, 2);
+  cache.set(3, 3);
+  BOOST_TEST(!!cache.shallow_read(1));
+  cache.set(4, 4);
+  BOOST_TEST((cache.size() == 3));
+  BOOST_TEST(!cache.shallow_read(2));
+  BOOST_TEST(!!cache.shallow_read(1));
+  BOOST_TEST(!!cache.shallow_read(3));
+  BOOST_TEST(!!cache.shallow_read(4));
+
+  const auto counters = cache.counters();
+  BOOST_TEST((counters.evictions == 1));
+  BOOST_TEST((counters.hits == 4));
+  BOOST_TEST((counters.misses == 1));
+
+  cache.flush(1);
+  BOOST_TEST((cache.size() == 2));
+  cache.flush();
+  BOOST_TEST((cache.size() == 0));
+}
+
+BOOST_AUTO_TEST_CASE(cache_clock_eviction) {
+  using Cache = dlib::Cache<int, int, dlib::Eviction_is<dlib::Clock_eviction>>;
+  Cache cache{ 3 };
+  cache.set(1, 1);
+  cache.set(2, 2);
+  cache.set(3, 3);
+  BOOST_TEST(!!cache.shallow_read(1));
+  cache.set(4, 4);
+  //1 had its second chance, 2 didn't
+  BOOST_TEST(!cache.shallow_read(2));
+  BOOST_TEST(!!cache.shallow_read(1));
+  for (int i = 5; i < 100; ++i) {
+    cache.set(i, i);
+    BOOST_TEST((cache.size() <= 3));
+  }
+  BOOST_TEST((cache.counters().evictions == 96));
+}
+
+BOOST_AUTO_TEST_CASE(cache_tiny_lfu_eviction) {
+  using Cache = dlib::Cache<int, int, dlib::Eviction_is<dlib::Tiny_lfu_eviction>, dlib::Shards_is<2>>;
+  Cache cache{ 100 };
+  //a popular working set
+  for (int round = 0; round < 10; ++round) {
+    for (int i = 0; i < 50; ++i) {
+      cache.deep_read(i);
+      cache.set(i, i);
+      cache.shallow_read(i);
+    }
+  }
+  //a scan of one-hit wonders shouldn't push it out while it stays popular
+  for (int i = 1000; i < 3000; ++i) {
+    cache.set(i, i);
+    cache.shallow_read(i % 50);
+    BOOST_TEST((cache.size() <= 100));
+  }
+  int kept = 0;
+  for (int i = 0; i < 50; ++i) {
+    kept += cache.shallow_read(i) ? 1 : 0;
+  }
+  BOOST_TEST((kept >= 40));
+}
+
+BOOST_AUTO_TEST_CASE(cache_eviction_copy) {
+  using Cache = dlib::Cache<int, int, dlib::Eviction_is<dlib::Lru_eviction>>;
+  Cache cache{ 2 };
+  cache.set(1, 1);
+  cache.set(2, 2);
+  Cache copy{ cache };
+  copy.set(3, 3);
+  BOOST_TEST((copy.size() == 2));
+  BOOST_TEST((cache.size() == 2));
+  BOOST_TEST(!!cache.shallow_read(1));
+}
+
+
+BOOST_AUTO_TEST_CASE(cache_coalesced_misses) {
+  using Cache = dlib::Cache<int, int>;
+  Cache cache;
+  auto source = std::make_shared<Slow_source>();
+  cache.add_source(source, dlib::finder_get(Slow_get{}));
+
+  std::vector<std::thread> threads;
+  std::atomic<bool> all_good{ true };
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&cache, &all_good]() {
+      auto read = cache.deep_read(7);
+      if (!read || *read.value() != 7) {
+        all_good = false;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  BOOST_TEST(all_good.load());
+  BOOST_TEST((source->gets.load() == 1));
+  BOOST_TEST(!!cache.shallow_read(7));
+}
+
+BOOST_AUTO_TEST_CASE(cache_set_during_fetch) {
+  using Cache = dlib::Cache<int, int>;
+  Cache cache;
+  auto source = std::make_shared<Slow_source>();
+  cache.add_source(source, dlib::finder_get(Slow_get{}));
+
+  std::thread reader{ [&cache]() {
+    cache.deep_read(3);
+  } };
+  while (source->gets.load() == 0) {
+    std::this_thread::yield();
+  }
+  //newer than whatever the fetch is about to bring back
+  cache.set(3, 30);
+  reader.join();
+  BOOST_TEST((*cache.shallow_read(3).value() == 30));
+}
+
+BOOST_AUTO_TEST_CASE(cache_flush_during_fetch) {
+  using Cache = dlib::Cache<int, int>;
+  Cache cache;
+  auto source = std::make_shared<Gated_source>();
+  cache.add_source(source, dlib::finder_get(Gated_get{}));
+
+  std::thread first{ [&cache]() {
+    cache.deep_read(5);
+  } };
+  while (source->gets.load() == 0) {
+    std::this_thread::yield();
+  }
+  cache.flush(5);
+
+  //after the flush, so it can't be answered by the fetch that's still going
+  int after = 0;
+  std::thread second{ [&cache, &after]() {
+    auto read = cache.deep_read(5);
+    if (read) {
+      after = *read.value();
+    }
+  } };
+  const auto giving_up = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (source->gets.load() < 2 && std::chrono::steady_clock::now() < giving_up) {
+    std::this_thread::yield();
+  }
+  source->open = true;
+  first.join();
+  second.join();
+  BOOST_TEST((after == 2));
+  BOOST_TEST((*cache.shallow_read(5).value() == 2));
+}
+
+BOOST_AUTO_TEST_CASE(cache_read_many) {
+  using Cache = dlib::Cache<int, int, dlib::Shards_is<4>>;
+  Cache cache;
+  auto batched = std::make_shared<Batched_source>();
+  cache.add_source(batched);
+
+  cache.set(1, 1);
+  cache.set(2, 2);
+  cache.set(3, 3);
+
+  const std::vector<int> keys = { 1, 2, 3, 4, 5, 6, 4, 100 };
+  auto lines = cache.read_many(keys);
+  BOOST_TEST((lines.size() == keys.size()));
+  for (size_t i = 0; i < 7; ++i) {
+    BOOST_TEST((!!lines[i] && *lines[i] == keys[i]));
+  }
+  BOOST_TEST(!lines[7]);
+  //4, 5, 6 and 100 in one go, the repeated 4 rides along
+  BOOST_TEST((batched->batches == 1));
+  BOOST_TEST((batched->asked == 4));
+  BOOST_TEST((batched->gets == 0));
+  BOOST_TEST(!!cache.shallow_read(5));
+
+  //falls through to a source without get_many for what the first didn't have
+  auto map{ std::make_shared<std::unordered_map<int, int>>() };
+  (*map)[100] = 7;
+  cache.add_source(map, dlib::finder_get(Get_as_shared_ptr<int, int>{}));
+  auto second = cache.read_many(keys);
+  BOOST_TEST((!!second[7] && *second[7] == 7));
+  BOOST_TEST((batched->batches == 2));
+}
+
+BOOST_AUTO_TEST_CASE(cache_ttl) {
+  using Cache = dlib::Cache<int, int, dlib::Clock_is<Test_clock>>;
+  using namespace std::chrono_literals;
+  Test_clock::ticks = 0;
+  Cache cache{ Cache::unbounded, Cache::Ttl{ 10ms, 100ms } };
+  auto source = std::make_shared<Counting_source>();
+  cache.add_source(source, dlib::finder_get(Counting_get{}));
+
+  BOOST_TEST((*cache.deep_read(1).value() == 1));
+  Test_clock::ticks = 5;
+  BOOST_TEST((*cache.deep_read(1).value() == 1));
+  BOOST_TEST((source->gets.load() == 1));
+
+  //stale, we still get the old line straight away, and a refresh goes out
+  Test_clock::ticks = 20;
+  BOOST_TEST((*cache.deep_read(1).value() == 1));
+  while (*cache.shallow_read(1).value() != 2) {
+    std::this_thread::yield();
+  }
+  BOOST_TEST((source->gets.load() == 2));
+
+  //expired, the read has to go to the source
+  Test_clock::ticks = 200;
+  BOOST_TEST(!cache.shallow_read(1));
+  BOOST_TEST((*cache.deep_read(1).value() == 3));
+
+  //a line set with its own ttl
+  cache.set_with_ttl(2, Cache::Ttl{ Cache::forever.soft, 1ms }, 20);
+  BOOST_TEST((*cache.shallow_read(2).value() == 20));
+  Test_clock::ticks = 202;
+  BOOST_TEST(!cache.shallow_read(2));
+}
+
+BOOST_AUTO_TEST_CASE(cache_ttl_refreshes_bounded) {
+  using Cache = dlib::Cache<int, int, dlib::Clock_is<Test_clock>>;
+  using namespace std::chrono_literals;
+  Test_clock::ticks = 0;
+  constexpr int keys = 64;
+  auto source = std::make_shared<Overlap_source>();
+  {
+    Cache cache{ Cache::unbounded, Cache::Ttl{ 10ms, 100ms } };
+    cache.add_source(source, dlib::finder_get(Overlap_get{}));
+    for (int key = 0; key < keys; ++key) {
+      cache.deep_read(key);
+    }
+
+    //every key stale at once, the refreshes queue rather than each getting a thread
+    Test_clock::ticks = 20;
+    source->most = 0;
+    for (int key = 0; key < keys; ++key) {
+      BOOST_TEST(!!cache.deep_read(key));
+    }
+    //going away waits on what's still queued
+  }
+  BOOST_TEST((source->gets.load() == 2 * keys));
+  BOOST_TEST((source->most.load() <= static_cast<int>(Cache::max_refreshers)));
+}
+
+BOOST_AUTO_TEST_CASE(cache_ttl_snapshot_reads) {
+  using Cache = dlib::Cache<int, int, dlib::Clock_is<Test_clock>, dlib::Reads_is<dlib::Snapshot_reads>>;
+  using namespace std::chrono_literals;
+  Test_clock::ticks = 0;
+  Cache cache{ Cache::unbounded, Cache::Ttl{ 10ms, 100ms } };
+  auto source = std::make_shared<Counting_source>();
+  cache.add_source(source, dlib::finder_get(Counting_get{}));
+
+  BOOST_TEST((*cache.deep_read(1).value() == 1));
+  Test_clock::ticks = 20;
+  BOOST_TEST((*cache.shallow_read(1).value() == 1));
+  while (*cache.shallow_read(1).value() != 2) {
+    std::this_thread::yield();
+  }
+  Test_clock::ticks = 200;
+  BOOST_TEST((*cache.deep_read(1).value() == 3));
+}
+
+BOOST_AUTO_TEST_CASE(cache_refresh_ahead) {
+  using Cache = dlib::Cache<int, int, dlib::Clock_is<Test_clock>>;
+  using namespace std::chrono_literals;
+  Test_clock::ticks = 0;
+  Cache cache{ Cache::unbounded, Cache::Ttl{ 10ms, 100ms } };
+  auto source = std::make_shared<Counting_source>();
+  cache.add_source(source, dlib::finder_get(Counting_get{}));
+
+  //1 is hot, 2 isn't
+  BOOST_TEST((*cache.deep_read(1).value() == 1));
+  BOOST_TEST((*cache.deep_read(2).value() == 2));
+  cache.shallow_read(1);
+  cache.shallow_read(1);
+
+  const Cache::Refresh_ahead options{ 5ms, 2, 4 };
+  //not close enough to going stale yet
+  BOOST_TEST((cache.refresh_ahead(options) == 0));
+
+  cache.shallow_read(1);
+  cache.shallow_read(1);
+  Test_clock::ticks = 6;
+  BOOST_TEST((cache.refresh_ahead(options) == 1));
+  BOOST_TEST((*cache.shallow_read(1).value() == 3));
+  BOOST_TEST((*cache.shallow_read(2).value() == 2));
+  BOOST_TEST((source->gets.load() == 3));
+
+  //counts start over every sweep
+  BOOST_TEST((cache.refresh_ahead(Cache::Refresh_ahead{ Cache::forever.soft, 2, 4 }) == 0));
+
+  //in the background, 1 keeps getting read so keeps getting refreshed
+  cache.start_refreshing_ahead(1ms, Cache::Refresh_ahead{ Cache::forever.soft, 1, 2 });
+  while (*cache.shallow_read(1).value() < 5) {
+    std::this_thread::yield();
+  }
+  cache.stop_refreshing_ahead();
+  BOOST_TEST((*cache.shallow_read(2).value() == 2));
+}
+
+BOOST_AUTO_TEST_CASE(cache_refresh_ahead_work_stealing) {
+  //however few workers the pool has, the helpers a sweep spawns still get run
+  using Cache = dlib::Cache<int, int, dlib::Clock_is<Test_clock>, dlib::Concurrency_is<dlib::Work_stealing_concurrency>>;
+  using namespace std::chrono_literals;
+  Test_clock::ticks = 0;
+  Cache cache{ Cache::unbounded, Cache::Ttl{ 10ms, 100ms } };
+  auto source = std::make_shared<Counting_source>();
+  cache.add_source(source, dlib::finder_get(Counting_get{}));
+  for (int key = 0; key < 8; ++key) {
+    cache.deep_read(key);
+    cache.shallow_read(key);
+  }
+
+  //a sweep from inside a pool task, which waits on helpers it spawned onto the same pool
+  Test_clock::ticks = 6;
+  size_t refreshed = 0;
+  dlib::Task_group<dlib::Work_stealing_concurrency> sweeping;
+  dlib::Work_stealing_concurrency::spawn(sweeping, [&cache, &refreshed]() {
+    refreshed = cache.refresh_ahead(Cache::Refresh_ahead{ 5ms, 1, 4 });
+  });
+  dlib::Work_stealing_concurrency::wait(sweeping);
+  BOOST_TEST((refreshed == 8));
+
+  //and in the background
+  const int swept = *cache.shallow_read(0).value();
+  cache.start_refreshing_ahead(1ms, Cache::Refresh_ahead{ Cache::forever.soft, 1, 4 });
+  //keeping them all hot, so each sweep has helpers to hand out
+  while (*cache.shallow_read(0).value() == swept) {
+    for (int key = 1; key < 8; ++key) {
+      cache.shallow_read(key);
+    }
+    std::this_thread::yield();
+  }
+  cache.stop_refreshing_ahead();
+}
+
+BOOST_AUTO_TEST_CASE(cache_weigher) {
+  using Cache = dlib::Cache<int, std::string, dlib::Eviction_is<dlib::Lru_eviction>, dlib::Weigher_is<String_size>>;
+  Cache cache{ 100 };
+  cache.set(1, std::string(40, 'a'));
+  cache.set(2, std::string(10, 'b'));
+  cache.set(3, std::string(30, 'c'));
+
+  auto footprint = cache.footprint(2);
+  BOOST_TEST((footprint.weight == 80));
+  BOOST_TEST((footprint.entries == 3));
+  BOOST_TEST((footprint.largest.size() == 2));
+  BOOST_TEST((footprint.largest[0] == std::pair<int, size_t>{ 1, 40 }));
+  BOOST_TEST((footprint.largest[1] == std::pair<int, size_t>{ 3, 30 }));
+
+  //40 more only fits if the least recently used 1 goes
+  cache.set(4, std::string(40, 'd'));
+  BOOST_TEST(!cache.shallow_read(1));
+  BOOST_TEST((cache.footprint().weight == 80));
+
+  //growing a line in place evicts too
+  cache.set(2, std::string(50, 'b'));
+  BOOST_TEST(!cache.shallow_read(3));
+  BOOST_TEST((cache.footprint().weight == 90));
+  BOOST_TEST((cache.counters().evictions == 2));
+
+  cache.flush(4);
+  BOOST_TEST((cache.footprint().weight == 50));
+  cache.flush();
+  BOOST_TEST((cache.footprint().weight == 0));
+}
+
+BOOST_AUTO_TEST_CASE(cache_statistics) {
+  using Cache = dlib::Cache<int, int, dlib::Shards_is<2>>;
+  Cache cache;
+  auto batched = std::make_shared<Batched_source>();
+  auto map{ std::make_shared<std::unordered_map<int, int>>() };
+  (*map)[200] = 2;
+  cache.add_source(batched);
+  cache.add_source(map, dlib::finder_get(Get_as_shared_ptr<int, int>{}));
+
+  cache.deep_read(1);
+  cache.deep_read(1);
+  const std::vector<int> keys = { 2, 3, 200 };
+  cache.read_many(keys);
+
+  const auto stats = cache.statistics();
+  BOOST_TEST((stats.counters.hits == 1));
+  BOOST_TEST((stats.entries == 4));
+  BOOST_TEST((stats.sources.size() == 2));
+  //1 on its own, then 2, 3 and 200 as a batch, the second source only gets asked for 200
+  BOOST_TEST((stats.sources[0].found == 3));
+  BOOST_TEST((stats.sources[0].missing == 1));
+  BOOST_TEST((stats.sources[0].latency.count() == 4));
+  BOOST_TEST((stats.sources[1].found == 1));
+  BOOST_TEST((stats.sources[1].missing == 0));
+  BOOST_TEST((stats.sources[1].latency.quantile(1) >= stats.sources[1].latency.quantile(0)));
+
+  using Quiet = dlib::Cache<int, int, dlib::Stats_is<dlib::No_stats>>;
+  Quiet quiet;
+  quiet.add_source(batched);
+  quiet.deep_read(1);
+  BOOST_TEST((quiet.statistics().sources[0].found == 0));
+}
+
+BOOST_AUTO_TEST_CASE(cache_snapshot) {
+  using Cache = dlib::Cache<int, std::vector<int>, dlib::Shards_is<4>>;
+  const std::string path = "cache_snapshot_test.bin";
+  {
+    Cache cache;
+    for (int i = 0; i < 100; ++i) {
+      cache.set(i, std::vector<int>(static_cast<size_t>(i % 7), i));
+    }
+    BOOST_TEST(!!cache.save_snapshot(path));
+  }
+
+  Cache warm;
+  auto loaded = warm.load_snapshot(path);
+  BOOST_TEST(!!loaded);
+  BOOST_TEST((loaded.value() == 100));
+  BOOST_TEST((warm.size() == 100));
+  for (int i = 0; i < 100; ++i) {
+    auto line = warm.shallow_read(i);
+    BOOST_TEST((!!line && *line.value() == std::vector<int>(static_cast<size_t>(i % 7), i)));
+  }
+
+  //a file that isn't a snapshot
+  {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    std::fputs("not a snapshot", file);
+    std::fclose(file);
+  }
+  BOOST_TEST(!Cache{}.load_snapshot(path));
+  std::remove(path.c_str());
+  BOOST_TEST(!Cache{}.load_snapshot(path));
+}
+
+BOOST_AUTO_TEST_CASE(numa_cache) {
+  using Cache = dlib::Numa_cache<int, int>;
+  Cache cache;
+  BOOST_TEST((cache.node_count() == dlib::numa_node_count()));
+  auto source = std::make_shared<Counting_source>();
+  cache.add_source(source, dlib::finder_get(Counting_get{}));
+
+  BOOST_TEST((*cache.deep_read(1).value() == 1));
+  BOOST_TEST((*cache.deep_read(1).value() == 1));
+  BOOST_TEST((source->gets.load() == 1));
+
+  //sets reach every node
+  cache.set(2, 20);
+  for (size_t node = 0; node < cache.node_count(); ++node) {
+    BOOST_TEST((*cache.node(node).shallow_read(2).value() == 20));
+  }
+  cache.flush(2);
+  BOOST_TEST((!cache.shallow_read(2)));
+  BOOST_TEST((cache.counters().hits >= 1));
+}
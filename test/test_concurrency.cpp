@@ -0,0 +1,151 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <dlib/concurrency.hpp>
+#include <dlib/cache.hpp>
+#include <dlib/pool.hpp>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+BOOST_AUTO_TEST_CASE(spin_mutex) {
+  dlib::Mutex<dlib::Spin_concurrency> mutex;
+  BOOST_TEST(mutex.try_lock());
+  BOOST_TEST(!mutex.try_lock());
+  mutex.unlock();
+
+  //long enough holds that some lockers give up spinning and park
+  constexpr int per_thread = 20000;
+  size_t counter = 0;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&mutex, &counter]() {
+      for (int i = 0; i < per_thread; ++i) {
+        std::lock_guard lock{ mutex };
+        if (i % 1000 == 0) {
+          std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        ++counter;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  BOOST_TEST((counter == 4 * per_thread));
+}
+
+BOOST_AUTO_TEST_CASE(spin_mutex_budget) {
+  dlib::Mutex<dlib::Spin_concurrency> mutex;
+
+  //short holds, which spinning may well get
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&mutex]() {
+      for (int i = 0; i < 20000; ++i) {
+        std::lock_guard lock{ mutex };
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  //held far past any spin, so every waiter parks, and each park pulls the budget down
+  const uint32_t before = mutex.spin_budget();
+  uint32_t last = before;
+  for (int round = 0; round < 20; ++round) {
+    mutex.lock();
+    std::thread waiter{ [&mutex]() {
+      std::lock_guard lock{ mutex };
+    } };
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    mutex.unlock();
+    waiter.join();
+    BOOST_TEST((mutex.spin_budget() <= last));
+    last = mutex.spin_budget();
+  }
+  BOOST_TEST((last < before || before == 0));
+}
+
+BOOST_AUTO_TEST_CASE(spin_mutex_destroyed_after_hand_off) {
+  //whoever gets the lock last may destroy it straight away, while the unlock that handed it over is still returning
+  for (int round = 0; round < 2000; ++round) {
+    auto mutex = std::make_unique<dlib::Mutex<dlib::Spin_concurrency>>();
+    mutex->lock();
+    std::thread taker{ [&mutex]() {
+      mutex->lock();
+      mutex->unlock();
+      mutex.reset();
+    } };
+    //from still spinning to well parked, so the hand off lands at different points in the taker
+    std::this_thread::sleep_for(std::chrono::microseconds(round % 50));
+    dlib::Mutex<dlib::Spin_concurrency>* const raw = mutex.get();
+    raw->unlock();
+    taker.join();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(sharded_shared_mutex) {
+  dlib::Shared_mutex<dlib::Spin_concurrency> mutex;
+  BOOST_TEST(mutex.try_lock_shared());
+  BOOST_TEST(mutex.try_lock_shared());
+  BOOST_TEST(!mutex.try_lock());
+  mutex.unlock_shared();
+  mutex.unlock_shared();
+  BOOST_TEST(mutex.try_lock());
+  BOOST_TEST(!mutex.try_lock_shared());
+  mutex.unlock();
+
+  //readers must never see the writer half way through
+  size_t left = 0;
+  size_t right = 0;
+  std::atomic<bool> torn{ false };
+  std::thread writer{ [&]() {
+    for (int i = 0; i < 20000; ++i) {
+      std::lock_guard lock{ mutex };
+      ++left;
+      ++right;
+    }
+  } };
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 3; ++t) {
+    readers.emplace_back([&]() {
+      for (int i = 0; i < 20000; ++i) {
+        std::shared_lock lock{ mutex };
+        if (left != right) {
+          torn = true;
+        }
+      }
+    });
+  }
+  writer.join();
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  BOOST_TEST(!torn.load());
+  BOOST_TEST((left == 20000));
+}
+
+BOOST_AUTO_TEST_CASE(spin_concurrency_pool_cache) {
+  using Pool = dlib::Pool<int, dlib::Concurrency_is<dlib::Spin_concurrency>>;
+  Pool pool{ dlib::Pool_limits{ 1, 1 }, []() { return 1; } };
+  auto held = pool.get();
+  BOOST_TEST(!!held);
+
+  //get_for waits on a Condition_variable over the spin mutex
+  std::thread giving{ [&held]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    held.value().reset();
+  } };
+  auto waited = pool.get_for([]() { return 2; }, std::chrono::seconds(10));
+  giving.join();
+  BOOST_TEST((!!waited && *waited.value() == 1));
+
+  dlib::Cache<int, int, dlib::Concurrency_is<dlib::Spin_concurrency>> cache;
+  cache.set(1, 2);
+  auto read = cache.shallow_read(1);
+  BOOST_TEST((!!read && *read.value() == 2));
+}
@@ -0,0 +1,204 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <dlib/db_pool.hpp>
+#include <dlib/dummy_db.hpp>
+#include <atomic>
+#include <chrono>
+
+namespace {
+  /*a clock that only moves when told to*/
+  struct Test_clock {
+    using rep = int64_t;
+    using period = std::milli;
+    using duration = std::chrono::duration<rep, period>;
+    using time_point = std::chrono::time_point<Test_clock>;
+    static constexpr bool is_steady = true;
+
+    static time_point now() noexcept {
+      return time_point{ duration{ ticks.load() } };
+    }
+
+    static inline std::atomic<rep> ticks{ 0 };
+  };
+
+  /*a driver that counts what's done to it, and can be told to go unhealthy*/
+  struct Counting_driver {
+    struct Prepared {
+      std::string sql;
+    };
+
+    dlib::Result<void> open(std::string_view) noexcept {
+      ++opened;
+      return dlib::success;
+    }
+    dlib::Result<void> close() noexcept {
+      ++closed;
+      return dlib::success;
+    }
+    dlib::Result<void> begin() noexcept {
+      return dlib::success;
+    }
+    dlib::Result<void> commit() noexcept {
+      return dlib::success;
+    }
+    dlib::Result<void> rollback() noexcept {
+      return dlib::success;
+    }
+    dlib::Result<void> ping() noexcept {
+      ++pings;
+      if (!healthy) {
+        return dlib::error("connection lost");
+      }
+      return dlib::success;
+    }
+    dlib::Result<Prepared> prepare(std::string_view sql) noexcept {
+      ++prepares;
+      return Prepared{ std::string{ sql } };
+    }
+    template<typename Cb, typename ...Args>
+    dlib::Result<void> execute(Prepared&, Cb&& cb, Args const& ...) noexcept {
+      dlib::dummy_db_impl::Result_set results;
+      return cb(results);
+    }
+
+    static void reset() noexcept {
+      opened = 0;
+      closed = 0;
+      pings = 0;
+      prepares = 0;
+      healthy = true;
+    }
+
+    static inline int opened = 0;
+    static inline int closed = 0;
+    static inline int pings = 0;
+    static inline int prepares = 0;
+    static inline bool healthy = true;
+  };
+
+  using Pool = dlib::Db_pool<Counting_driver, dlib::Clock_is<Test_clock>>;
+}
+
+BOOST_AUTO_TEST_CASE(db_pool_checkout) {
+  Counting_driver::reset();
+  Pool pool{ "", dlib::Db_pool_options{ dlib::Pool_limits{ 2 } } };
+  BOOST_TEST((Counting_driver::opened == 2));
+  {
+    auto checkout = pool.get();
+    BOOST_TEST(!!checkout);
+    BOOST_TEST((pool.in_use() == 1));
+    BOOST_TEST((pool.idle() == 1));
+  }
+  //back when the handle goes
+  BOOST_TEST((pool.in_use() == 0));
+  BOOST_TEST((pool.idle() == 2));
+  BOOST_TEST((Counting_driver::opened == 2));
+}
+
+BOOST_AUTO_TEST_CASE(db_pool_invalidate) {
+  Counting_driver::reset();
+  Pool pool{ "", dlib::Db_pool_options{ dlib::Pool_limits{ 2 } } };
+  auto checkout = pool.get();
+  pool.invalidate();
+  //idle ones close straight away
+  BOOST_TEST((pool.idle() == 0));
+  BOOST_TEST((Counting_driver::closed == 1));
+  //and the one out closes when it comes back
+  checkout = pool.get();
+  BOOST_TEST((Counting_driver::closed == 2));
+  BOOST_TEST((Counting_driver::opened == 3));
+  BOOST_TEST((pool.idle() == 0));
+  BOOST_TEST((pool.version() == 1));
+}
+
+BOOST_AUTO_TEST_CASE(db_pool_health_check) {
+  using namespace std::chrono_literals;
+  Counting_driver::reset();
+  Test_clock::ticks = 0;
+  dlib::Db_pool_options options;
+  options.check_after = 10ms;
+  Pool pool{ "", options };
+  pool.get();
+  //back recently, so no check
+  pool.get();
+  BOOST_TEST((Counting_driver::pings == 0));
+
+  Test_clock::ticks = 20;
+  pool.get();
+  BOOST_TEST((Counting_driver::pings == 1));
+  BOOST_TEST((Counting_driver::opened == 1));
+
+  //a dead connection gets closed and replaced
+  Counting_driver::healthy = false;
+  Test_clock::ticks = 40;
+  auto checkout = pool.get();
+  BOOST_TEST(!!checkout);
+  BOOST_TEST((Counting_driver::closed == 1));
+  BOOST_TEST((Counting_driver::opened == 2));
+  BOOST_TEST((pool.in_use() == 1));
+}
+
+BOOST_AUTO_TEST_CASE(db_pool_prewarmed_health_check) {
+  using namespace std::chrono_literals;
+  Counting_driver::reset();
+  Test_clock::ticks = 0;
+  dlib::Db_pool_options options;
+  options.limits = dlib::Pool_limits{ 2 };
+  options.check_after = 10ms;
+  Pool pool{ "", options };
+  BOOST_TEST((Counting_driver::opened == 2));
+
+  //warmed up and never out, but idle long enough to be checked
+  Test_clock::ticks = 20;
+  auto checkout = pool.get();
+  BOOST_TEST(!!checkout);
+  BOOST_TEST((Counting_driver::pings == 1));
+}
+
+BOOST_AUTO_TEST_CASE(db_pool_reap_idle) {
+  using namespace std::chrono_literals;
+  Counting_driver::reset();
+  Test_clock::ticks = 0;
+  dlib::Db_pool_options options;
+  options.limits = dlib::Pool_limits{ 1 };
+  options.max_idle = 100ms;
+  Pool pool{ "", options };
+  {
+    auto first = pool.get();
+    auto second = pool.get();
+    auto third = pool.get();
+  }
+  BOOST_TEST((pool.idle() == 3));
+  Test_clock::ticks = 50;
+  BOOST_TEST((pool.reap_idle() == 0));
+  Test_clock::ticks = 100;
+  //limits.min stay
+  BOOST_TEST((pool.reap_idle() == 2));
+  BOOST_TEST((pool.idle() == 1));
+  BOOST_TEST((Counting_driver::closed == 2));
+}
+
+BOOST_AUTO_TEST_CASE(db_pool_prepared_statements) {
+  Counting_driver::reset();
+  Pool pool{ "" };
+  {
+    auto checkout = pool.get();
+    BOOST_TEST(!!checkout.value()->execute("SELECT 1;", []() {}));
+    BOOST_TEST(!!checkout.value()->execute("SELECT 1;", []() {}));
+    BOOST_TEST(!!checkout.value()->execute("SELECT 2;", []() {}));
+    BOOST_TEST((checkout.value()->prepared() == 2));
+  }
+  //same connection back, statements and all
+  auto checkout = pool.get();
+  BOOST_TEST(!!checkout.value()->execute("SELECT 2;", []() {}));
+  BOOST_TEST((Counting_driver::prepares == 2));
+}
+
+BOOST_AUTO_TEST_CASE(db_pool_health_query) {
+  //the dummy driver has no ping, so the check runs the health query
+  dlib::Db_pool<dlib::Dummy_db_driver> pool{ "" };
+  auto checkout = pool.get();
+  BOOST_TEST(!!checkout);
+  BOOST_TEST(!!checkout.value()->execute("SELECT 1;", []() {}));
+}
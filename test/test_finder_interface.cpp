@@ -84,4 +84,40 @@ BOOST_AUTO_TEST_CASE(finder_interface_custom) {
   Interface test{ Dummy{}, dlib::finder_contains(Shitty_lambda{}) };
   test.get(0);
   test.contains(0);
-}*/
\ No newline at end of file
+}*/
+namespace {
+  struct Batched_dummy {
+    int get(int i) noexcept {
+      return i;
+    }
+    bool contains(int) noexcept {
+      return true;
+    }
+    std::vector<std::optional<int>> get_many(dlib::Array_view<const int> keys) noexcept {
+      ++batches;
+      std::vector<std::optional<int>> returning;
+      for (int key : keys) {
+        returning.emplace_back(key * 2);
+      }
+      return returning;
+    }
+    int batches = 0;
+  };
+}
+
+BOOST_AUTO_TEST_CASE(finder_interface_get_many) {
+  const int keys[] = { 1, 2, 3 };
+
+  auto batched = std::make_shared<Batched_dummy>();
+  dlib::Finder_interface<int, int> batching{ batched };
+  auto got = batching.get_many(keys);
+  BOOST_TEST((batched->batches == 1));
+  BOOST_TEST((got.size() == 3));
+  BOOST_TEST((got[2].value() == 6));
+
+  //no get_many, falls back to get one at a time
+  dlib::Finder_interface<int, int> fallback{ Defaulted_dummy{} };
+  auto fell_back = fallback.get_many(keys);
+  BOOST_TEST((fell_back.size() == 3));
+  BOOST_TEST((fell_back[1].value() == 2));
+}
@@ -2,6 +2,12 @@
 #include <boost/test/unit_test.hpp>
 
 #include <dlib/pool.hpp>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <stdexcept>
 
 
 
@@ -14,11 +20,34 @@ BOOST_AUTO_TEST_CASE(pool) {
   dlib::Pool<int, dlib::Pointer_is<dlib::Raw_pointer>> pool;
 }
 
+BOOST_AUTO_TEST_CASE(pool_shared_pointer_outlived) {
+  using Pool = dlib::Pool<int, dlib::Pointer_is<dlib::Shared_pointer>>;
+  auto pool = std::make_shared<Pool>();
+  std::weak_ptr<Pool> watching = pool;
+  auto first = std::make_optional(std::move(pool->get([]() {return 5;}).value()));
+  auto second = std::make_optional(std::move(pool->get([]() {return 6;}).value()));
+  BOOST_TEST((!!*first && !!*second));
+
+  //what's out of the pool keeps it alive, and still goes back to it
+  pool.reset();
+  BOOST_TEST(!watching.expired());
+  {
+    auto looking = watching.lock();
+    first.reset();
+    BOOST_TEST((looking->stats().returned == 1));
+  }
+
+  //the last one out gives back to the pool, then lets it go
+  second.reset();
+  BOOST_TEST(watching.expired());
+}
+
 BOOST_AUTO_TEST_CASE(pool_finite) {
   dlib::Pool<int, dlib::Pointer_is<dlib::Raw_pointer>> pool;
   BOOST_TEST((!pool.get()));
   pool.give_back(1);
-  BOOST_TEST((!!pool.get()));
+  auto got = pool.get();
+  BOOST_TEST((!!got));
   BOOST_TEST((!pool.get()));
 }
 
@@ -26,4 +55,266 @@ BOOST_AUTO_TEST_CASE(pool_construct) {
   dlib::Pool<int, dlib::Pointer_is<dlib::Raw_pointer>> pool;
   BOOST_TEST((!pool.get()));
   BOOST_TEST((!!pool.get([]() {return 0;})));
-}
\ No newline at end of file
+}
+
+BOOST_AUTO_TEST_CASE(magazine_pool) {
+  dlib::Magazine_pool<int, dlib::Magazine_size_is<2>> pool;
+  BOOST_TEST((!pool.get()));
+  for (int i = 0; i < 5; ++i) {
+    pool.give_back(i);
+  }
+  int total = 0;
+  std::vector<decltype(pool)::Pointer> holding;
+  for (int i = 0; i < 5; ++i) {
+    auto got = pool.get();
+    BOOST_TEST((!!got));
+    total += *got.value();
+    holding.push_back(std::move(got.value()));
+  }
+  BOOST_TEST((total == 10));
+  BOOST_TEST((!pool.get()));
+  BOOST_TEST((!!pool.get([]() { return 7; })));
+}
+
+BOOST_AUTO_TEST_CASE(magazine_pool_in_use) {
+  using Pool = dlib::Magazine_pool<int, dlib::Magazine_size_is<2>>;
+  Pool pool;
+
+  //threads past the ones with magazines give back to the locked pool
+  const size_t starting = dlib::pool_impl::max_magazine_threads + 16;
+  std::atomic<size_t> given{ 0 };
+  std::atomic<bool> done{ false };
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < starting; ++t) {
+    threads.emplace_back([&pool, &given, &done, t]() {
+      pool.give_back(static_cast<int>(t));
+      ++given;
+      while (!done.load()) {
+        std::this_thread::yield();
+      }
+    });
+  }
+  while (given.load() != starting) {
+    std::this_thread::yield();
+  }
+  done = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  //taking those from the locked pool and giving them back to our magazines, round and round
+  for (int round = 0; round < 4; ++round) {
+    std::vector<Pool::Pointer> holding;
+    for (auto got = pool.get(); got; got = pool.get()) {
+      holding.push_back(std::move(got.value()));
+    }
+    BOOST_TEST((!holding.empty()));
+  }
+  BOOST_TEST((pool.in_use() == 0));
+}
+
+BOOST_AUTO_TEST_CASE(magazine_pool_threads) {
+  using Pool = dlib::Magazine_pool<std::unique_ptr<int>, dlib::Magazine_size_is<4>>;
+  Pool pool;
+  std::atomic<int> constructed{ 0 };
+  std::atomic<bool> all_good{ true };
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&pool, &constructed, &all_good]() {
+      std::vector<Pool::Pointer> holding;
+      for (int i = 0; i < 10000; ++i) {
+        auto got = pool.get([&constructed]() {
+          ++constructed;
+          return std::make_unique<int>(42);
+        });
+        if (!got || **got.value() != 42) {
+          all_good = false;
+        }
+        holding.push_back(std::move(got.value()));
+        if (holding.size() == 3) {
+          holding.clear();
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  BOOST_TEST(all_good.load());
+  //everyone mostly recycles their own
+  BOOST_TEST((constructed.load() < 8 * 100));
+
+  //a thread giving back more than its magazines hold passes full magazines on to us
+  std::thread{ [&pool]() {
+    for (int i = 0; i < 100; ++i) {
+      pool.give_back(std::make_unique<int>(i));
+    }
+  } }.join();
+  std::vector<Pool::Pointer> recovered;
+  for (auto got = pool.get(); got; got = pool.get()) {
+    recovered.push_back(std::move(got.value()));
+  }
+  BOOST_TEST((recovered.size() >= 100 - 2 * 4));
+}
+
+BOOST_AUTO_TEST_CASE(pool_limits) {
+  using Pool = dlib::Pool<int>;
+  int constructed = 0;
+  const auto constructor = [&constructed]() { return ++constructed; };
+
+  Pool pool{ dlib::Pool_limits{ 2, 3, 2 }, constructor };
+  BOOST_TEST((constructed == 2));
+  BOOST_TEST((pool.idle() == 2));
+
+  auto a = pool.get(constructor);
+  auto b = pool.get(constructor);
+  auto c = pool.get(constructor);
+  BOOST_TEST((!!a && !!b && !!c));
+  BOOST_TEST((constructed == 3));
+  BOOST_TEST((pool.in_use() == 3));
+  //at our max
+  BOOST_TEST((!pool.get(constructor)));
+  BOOST_TEST((!pool.get_for(constructor, std::chrono::milliseconds(1))));
+
+  a.value().reset();
+  b.value().reset();
+  //past the high watermark, so dropped
+  c.value().reset();
+  BOOST_TEST((pool.idle() == 2));
+  BOOST_TEST((pool.in_use() == 0));
+  BOOST_TEST((pool.stats().dropped == 1));
+}
+
+BOOST_AUTO_TEST_CASE(pool_constructor_fails) {
+  using Pool = dlib::Pool<int>;
+  Pool pool{ dlib::Pool_limits{ 0, 1 } };
+
+  //failing at our max, again and again, never uses up the room
+  for (int i = 0; i < 3; ++i) {
+    BOOST_TEST((!pool.get([]() { return dlib::Result<int>{ dlib::error("can't connect") }; })));
+    BOOST_CHECK_THROW(pool.get([]() -> int { throw std::runtime_error{ "can't connect" }; }), std::runtime_error);
+  }
+  BOOST_TEST((pool.in_use() == 0));
+  BOOST_TEST((pool.stats().constructed == 0));
+  BOOST_TEST((!!pool.get([]() { return 1; })));
+}
+
+BOOST_AUTO_TEST_CASE(pool_get_for_waits) {
+  using Pool = dlib::Pool<int>;
+  Pool pool{ dlib::Pool_limits{ 1, 1 }, []() { return 1; } };
+  auto held = pool.get();
+  BOOST_TEST(!!held);
+
+  std::thread giving{ [&pool, &held]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    held.value().reset();
+  } };
+  auto waited = pool.get_for([]() { return 2; }, std::chrono::seconds(10));
+  giving.join();
+  BOOST_TEST((!!waited && *waited.value() == 1));
+}
+
+BOOST_AUTO_TEST_CASE(versioned_pool_limits) {
+  using Pool = dlib::Versioned_pool<int>;
+  Pool pool{ dlib::Pool_limits{ 0, 1 } };
+  auto got = pool.get([]() { return 1; });
+  BOOST_TEST(!!got);
+  BOOST_TEST((!pool.get([]() { return 2; })));
+  pool.increment_version();
+  //old, so destroyed, which frees up room under the max
+  got.value().reset();
+  BOOST_TEST((pool.idle() == 0));
+  BOOST_TEST((!!pool.get([]() { return 3; })));
+}
+
+namespace {
+  template<typename Pool>
+  dlib::Result<int> use_and_bail(Pool& pool) noexcept {
+    DLIB_TRY(got, (pool.get([]() { return 1; })));
+    DLIB_TRY((dlib::Result<void>{ dlib::error("bailing out") }));
+    return *got;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(pool_returning_pointer) {
+  using Pool = dlib::Pool<int>;
+  Pool pool;
+  {
+    auto got = pool.get([]() { return 1; });
+    BOOST_TEST((pool.in_use() == 1));
+  }
+  //back when the pointer went
+  BOOST_TEST((pool.idle() == 1));
+  BOOST_TEST((pool.in_use() == 0));
+
+  //even when we leave early through DLIB_TRY
+  BOOST_TEST((!use_and_bail(pool)));
+  BOOST_TEST((pool.idle() == 1));
+
+  auto got = pool.get();
+  Pool::Pointer moved = std::move(got.value());
+  BOOST_TEST((!got.value()));
+  BOOST_TEST((!!moved && *moved == 1));
+  moved.reset();
+  BOOST_TEST((!moved));
+
+  const dlib::Pool_stats stats = pool.stats();
+  BOOST_TEST((stats.constructed == 1));
+  BOOST_TEST((stats.recycled == 2));
+  BOOST_TEST((stats.returned == 3));
+  BOOST_TEST((stats.leaked == 0));
+}
+
+BOOST_AUTO_TEST_CASE(pool_leaked) {
+  using Pool = dlib::Versioned_pool<int>;
+  Pool pool{ dlib::Pool_limits{ 0, 1 } };
+  {
+    auto got = pool.get([]() { return 1; });
+    //released and never given back
+    Pool::Pooled released = std::move(*got.value().release());
+  }
+  const dlib::Pool_stats stats = pool.stats();
+  BOOST_TEST((stats.leaked == 1));
+  BOOST_TEST((stats.recycle_rate() == 0.0));
+  //the leak made room under our max again
+  BOOST_TEST((pool.in_use() == 0));
+  BOOST_TEST((!!pool.get([]() { return 2; })));
+}
+
+BOOST_AUTO_TEST_CASE(pool_release_empty) {
+  using Pool = dlib::Pool<int>;
+  Pool pool;
+  auto got = pool.get([]() { return 1; });
+  Pool::Pointer moved = std::move(got.value());
+  //nothing left to release, from what was moved from or from what's already released
+  BOOST_TEST((!got.value().release()));
+  auto released = moved.release();
+  BOOST_TEST((!!released && released->value == 1));
+  BOOST_TEST((!moved.release()));
+  pool.give_back(std::move(*released));
+  BOOST_TEST((pool.idle() == 1));
+  BOOST_TEST((pool.in_use() == 0));
+}
+
+BOOST_AUTO_TEST_CASE(numa_pool) {
+  using Pool = dlib::Numa_pool<int>;
+  Pool pool{ dlib::Pool_limits{ 1 }, []() { return 1; } };
+  BOOST_TEST((pool.node_count() == dlib::numa_node_count()));
+  //every node pre-warmed
+  BOOST_TEST((pool.idle() == pool.node_count()));
+  {
+    auto got = pool.get([]() { return 2; });
+    BOOST_TEST((!!got && *got.value() == 1));
+    BOOST_TEST((pool.in_use() == 1));
+  }
+  BOOST_TEST((pool.in_use() == 0));
+  BOOST_TEST((pool.idle() == pool.node_count()));
+
+  //released objects still find their way home
+  auto got = pool.get();
+  Pool::Pooled released = std::move(*got.value().release());
+  pool.give_back(std::move(released));
+  BOOST_TEST((pool.in_use() == 0));
+  BOOST_TEST((pool.stats().leaked == 0));
+}
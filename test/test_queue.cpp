@@ -0,0 +1,146 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <dlib/queue.hpp>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+  /*every producer pushes its share of 0..count, every consumer checks off what it pops*/
+  template<typename Queue>
+  bool each_once(Queue& queue, size_t producers, size_t consumers, size_t count, size_t batch) {
+    std::vector<std::atomic<int>> seen(count);
+    std::atomic<size_t> popped{ 0 };
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; ++p) {
+      threads.emplace_back([&, p]() {
+        std::vector<size_t> values;
+        for (size_t i = p; i < count; i += producers) {
+          values.push_back(i);
+          if (values.size() == batch || i + producers >= count) {
+            size_t pushed = 0;
+            while (pushed < values.size()) {
+              const size_t went = queue.push_n(dlib::Array_view<size_t>{ values.data() + pushed, values.size() - pushed });
+              if (went == 0) {
+                std::this_thread::yield();
+              }
+              pushed += went;
+            }
+            values.clear();
+          }
+        }
+      });
+    }
+    for (size_t c = 0; c < consumers; ++c) {
+      threads.emplace_back([&]() {
+        std::vector<size_t> out(batch);
+        while (popped.load() < count) {
+          const size_t got = queue.pop_n(out);
+          if (got == 0) {
+            std::this_thread::yield();
+          }
+          for (size_t i = 0; i < got; ++i) {
+            ++seen[out[i]];
+          }
+          popped += got;
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    for (auto const& times : seen) {
+      if (times.load() != 1) {
+        return false;
+      }
+    }
+    return queue.empty();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(mpmc_queue) {
+  dlib::Mpmc_queue<int> queue{ 3 };
+  BOOST_TEST((queue.capacity() == 4));
+  BOOST_TEST(!queue.try_pop());
+  for (int i = 0; i < 4; ++i) {
+    BOOST_TEST(queue.try_push(i));
+  }
+  BOOST_TEST(!queue.try_push(4));
+  BOOST_TEST((queue.size() == 4));
+  BOOST_TEST((*queue.try_pop() == 0));
+  BOOST_TEST(queue.try_push(4));
+
+  int out[8] = {};
+  BOOST_TEST((queue.pop_n(out) == 4));
+  BOOST_TEST((out[0] == 1 && out[3] == 4));
+  BOOST_TEST(queue.empty());
+
+  //only as many as fit go in
+  int in[6] = { 10, 11, 12, 13, 14, 15 };
+  BOOST_TEST((queue.push_n(in) == 4));
+  BOOST_TEST((queue.pop_n(dlib::Array_view<int>{ out, 2 }) == 2));
+  BOOST_TEST((out[0] == 10 && out[1] == 11));
+}
+
+BOOST_AUTO_TEST_CASE(mpmc_queue_owns) {
+  auto counted = std::make_shared<int>(0);
+  {
+    dlib::Mpmc_queue<std::shared_ptr<int>> queue{ 4 };
+    std::shared_ptr<int> kept = counted;
+    BOOST_TEST(queue.try_push(std::move(kept)));
+    BOOST_TEST(queue.try_push(counted));
+    BOOST_TEST(queue.try_push(counted));
+    BOOST_TEST(queue.try_push(counted));
+    //full, so kept isn't moved from
+    kept = counted;
+    BOOST_TEST(!queue.try_push(std::move(kept)));
+    BOOST_TEST(!!kept);
+    BOOST_TEST((counted.use_count() == 6));
+    BOOST_TEST(!!queue.try_pop());
+  }
+  //what was left in the queue went with it
+  BOOST_TEST((counted.use_count() == 1));
+}
+
+BOOST_AUTO_TEST_CASE(mpmc_queue_threads) {
+  dlib::Mpmc_queue<size_t> queue{ 64 };
+  BOOST_TEST(each_once(queue, 4, 4, 100000, 8));
+  BOOST_TEST(each_once(queue, 1, 3, 20000, 1));
+  BOOST_TEST(each_once(queue, 3, 1, 20000, 32));
+}
+
+BOOST_AUTO_TEST_CASE(spsc_ring) {
+  dlib::Spsc_ring<int> ring{ 4 };
+  BOOST_TEST(!ring.try_pop());
+  int in[6] = { 0, 1, 2, 3, 4, 5 };
+  BOOST_TEST((ring.push_n(in) == 4));
+  BOOST_TEST(!ring.try_push(4));
+  BOOST_TEST((*ring.try_pop() == 0));
+  BOOST_TEST(ring.try_push(4));
+
+  int out[8] = {};
+  BOOST_TEST((ring.pop_n(out) == 4));
+  BOOST_TEST((out[0] == 1 && out[3] == 4));
+  BOOST_TEST(ring.empty());
+
+  //without threads the indices are plain
+  dlib::Spsc_ring<int, dlib::Concurrency_is<dlib::Null_concurrency>> single{ 2 };
+  BOOST_TEST(single.try_push(1));
+  BOOST_TEST((*single.try_pop() == 1));
+}
+
+BOOST_AUTO_TEST_CASE(spsc_ring_threads) {
+  dlib::Spsc_ring<size_t> ring{ 64 };
+  BOOST_TEST(each_once(ring, 1, 1, 200000, 16));
+  BOOST_TEST(each_once(ring, 1, 1, 20000, 1));
+
+  auto counted = std::make_shared<int>(0);
+  {
+    dlib::Spsc_ring<std::shared_ptr<int>> owning{ 4 };
+    owning.try_push(counted);
+    owning.try_push(counted);
+  }
+  BOOST_TEST((counted.use_count() == 1));
+}
@@ -0,0 +1,380 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <dlib/raft_memory.hpp>
+#include <vector>
+
+namespace {
+  using namespace dlib::raft;
+
+  std::vector<std::byte> bytes(size_t value, size_t size = 8) {
+    std::vector<std::byte> made(size);
+    for (size_t i = 0; i < size; ++i) {
+      made[i] = static_cast<std::byte>((value >> (8 * (i % 8))) & 0xff);
+    }
+    return made;
+  }
+
+  /*every node applied exactly entries 0 to count, in order*/
+  bool appliedAll(MemoryCluster& cluster, size_t count) {
+    for (NodeId id = 1; id <= cluster.size(); ++id) {
+      auto const& applied = cluster.node(id).driver().applied();
+      if (applied.size() != count) {
+        return false;
+      }
+      for (size_t i = 0; i < count; ++i) {
+        if (applied[i] != bytes(i)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  void proposeAll(MemoryCluster& cluster, NodeId leader, size_t from, size_t to) {
+    for (size_t i = from; i < to; ++i) {
+      auto data = bytes(i);
+      BOOST_TEST((cluster.node(leader).propose(data) == Result::Success));
+    }
+  }
+
+  /*delivers what's in flight a round at a time, returns how many rounds it took*/
+  size_t hops(MemoryCluster& cluster) {
+    size_t rounds = 0;
+    for (; cluster.pending() != 0; ++rounds) {
+      cluster.deliver(cluster.pending());
+    }
+    return rounds;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(raft_election) {
+  MemoryCluster cluster{ 3 };
+  BOOST_TEST((cluster.leader() == 0));
+  BOOST_TEST((cluster.elect(2) == 2));
+  BOOST_TEST(cluster.node(1).isFollower());
+  BOOST_TEST(cluster.node(3).isFollower());
+  BOOST_TEST((cluster.node(1).driver().currentTerm() == 1));
+
+  //only the leader takes proposals
+  auto data = bytes(0);
+  BOOST_TEST((cluster.node(1).propose(data) == Result::Failure));
+}
+
+BOOST_AUTO_TEST_CASE(raft_replication_batched) {
+  ReplicationOptions replication;
+  replication.maxEntries = 16;
+  MemoryCluster cluster{ 3, replication };
+  const NodeId leader = cluster.elect(1);
+  BOOST_TEST((leader == 1));
+  const uint64_t before = cluster.appendEntriesSent();
+
+  proposeAll(cluster, leader, 0, 100);
+  cluster.settle();
+  //the first entry goes alone, then 16 at a time
+  BOOST_TEST((cluster.appendEntriesSent() - before == 2 * (1 + 7)));
+  cluster.heartbeat(leader);
+  BOOST_TEST(appliedAll(cluster, 100));
+
+  //one at a time takes one AppendEntries per entry per follower
+  replication.maxEntries = 1;
+  MemoryCluster single{ 3, replication };
+  single.elect(1);
+  const uint64_t singleBefore = single.appendEntriesSent();
+  proposeAll(single, 1, 0, 100);
+  single.settle();
+  BOOST_TEST((single.appendEntriesSent() - singleBefore == 200));
+  single.heartbeat(1);
+  BOOST_TEST(appliedAll(single, 100));
+}
+
+BOOST_AUTO_TEST_CASE(raft_replication_max_bytes) {
+  ReplicationOptions replication;
+  replication.maxEntries = 64;
+  replication.maxBytes = 20;
+  MemoryCluster cluster{ 2, replication };
+  cluster.elect(1);
+  const uint64_t before = cluster.appendEntriesSent();
+  //8 byte entries, so 2 fit in 20 bytes
+  proposeAll(cluster, 1, 0, 11);
+  cluster.settle();
+  BOOST_TEST((cluster.appendEntriesSent() - before == 1 + 5));
+  cluster.heartbeat(1);
+  BOOST_TEST(appliedAll(cluster, 11));
+}
+
+BOOST_AUTO_TEST_CASE(raft_replication_pipelined) {
+  ReplicationOptions replication;
+  replication.maxEntries = 4;
+  MemoryCluster stopAndWait{ 3, replication };
+  stopAndWait.elect(1);
+  proposeAll(stopAndWait, 1, 0, 65);
+  const size_t stopAndWaitHops = hops(stopAndWait);
+
+  replication.maxInFlight = 4;
+  MemoryCluster pipelined{ 3, replication };
+  pipelined.elect(1);
+  const uint64_t before = pipelined.appendEntriesSent();
+  proposeAll(pipelined, 1, 0, 65);
+  const size_t pipelinedHops = hops(pipelined);
+  //the first entry goes alone, then a batch of 4 each round trip
+  BOOST_TEST((stopAndWaitHops == 2 * (1 + 16)));
+  //the first 4 entries fill the window on their own, then 4 batches of 4 go each round trip
+  BOOST_TEST((pipelinedHops == 2 * (1 + 4)));
+  BOOST_TEST((pipelined.appendEntriesSent() - before == 2 * (4 + 16)));
+  pipelined.heartbeat(1);
+  BOOST_TEST(appliedAll(pipelined, 65));
+}
+
+BOOST_AUTO_TEST_CASE(raft_replication_pipelined_rollback) {
+  ReplicationOptions replication;
+  replication.maxEntries = 4;
+  replication.maxInFlight = 4;
+  MemoryCluster cluster{ 3, replication };
+  cluster.elect(1);
+  proposeAll(cluster, 1, 0, 5);
+  cluster.settle();
+
+  //these go out to 3 optimistically, and are lost
+  cluster.isolate(3);
+  proposeAll(cluster, 1, 5, 40);
+  cluster.settle();
+  BOOST_TEST((cluster.node(3).driver().written() == 5));
+
+  //the heartbeat assumes 3 has them all, it doesn't, so the leader goes back to what 3 acknowledged
+  cluster.isolate(3, false);
+  cluster.heartbeat(1);
+  BOOST_TEST((cluster.node(3).driver().written() == 40));
+  cluster.heartbeat(1);
+  BOOST_TEST(appliedAll(cluster, 40));
+}
+
+BOOST_AUTO_TEST_CASE(raft_replication_pipelined_lost_window) {
+  ReplicationOptions replication;
+  replication.maxEntries = 1;
+  replication.maxInFlight = 4;
+  MemoryCluster cluster{ 2, replication };
+  cluster.elect(1);
+  proposeAll(cluster, 1, 0, 1);
+  cluster.settle();
+
+  //the first of the window is lost, so everything sent after it fails
+  cluster.isolate(2);
+  proposeAll(cluster, 1, 1, 2);
+  cluster.settle();
+  cluster.isolate(2, false);
+  proposeAll(cluster, 1, 2, 5);
+  const uint64_t before = cluster.appendEntriesSent();
+  cluster.settle();
+
+  //the first failure sends one probe, the late ones from the same window don't send more
+  BOOST_TEST((cluster.appendEntriesSent() - before == 1 + 3));
+  cluster.heartbeat(1);
+  BOOST_TEST(appliedAll(cluster, 5));
+}
+
+BOOST_AUTO_TEST_CASE(raft_lagging_follower) {
+  MemoryCluster cluster{ 3 };
+  const NodeId leader = cluster.elect(1);
+  cluster.isolate(3);
+  proposeAll(cluster, leader, 0, 50);
+  cluster.settle();
+  cluster.heartbeat(leader);
+  //a majority is enough to commit
+  BOOST_TEST((cluster.node(2).driver().applied().size() == 50));
+  BOOST_TEST((cluster.node(3).driver().applied().empty()));
+
+  cluster.isolate(3, false);
+  cluster.heartbeat(leader);
+  //the follower has its entries, and learns they're committed with the next heartbeat
+  BOOST_TEST((cluster.node(3).driver().written() == 50));
+  cluster.heartbeat(leader);
+  BOOST_TEST(appliedAll(cluster, 50));
+}
+
+BOOST_AUTO_TEST_CASE(raft_new_leader) {
+  MemoryCluster cluster{ 3 };
+  cluster.elect(1);
+  proposeAll(cluster, 1, 0, 10);
+  cluster.settle();
+  cluster.heartbeat(1);
+
+  cluster.isolate(1);
+  BOOST_TEST((cluster.elect(2) == 2));
+  BOOST_TEST((cluster.node(2).driver().currentTerm() == 2));
+  proposeAll(cluster, 2, 10, 20);
+  cluster.settle();
+
+  //the old leader steps down once it hears of the new term, and catches up
+  cluster.isolate(1, false);
+  cluster.heartbeat(2);
+  cluster.heartbeat(2);
+  BOOST_TEST(cluster.node(1).isFollower());
+  BOOST_TEST(appliedAll(cluster, 20));
+}
+
+BOOST_AUTO_TEST_CASE(raft_conflict_hints) {
+  MemoryCluster cluster{ 3 };
+  cluster.elect(1);
+  proposeAll(cluster, 1, 0, 10);
+  cluster.settle();
+  cluster.heartbeat(1);
+
+  //the old leader keeps taking proposals nobody else will hear of
+  cluster.isolate(1);
+  for (size_t i = 0; i < 500; ++i) {
+    auto data = bytes(1000 + i);
+    cluster.node(1).propose(data);
+  }
+  BOOST_TEST((cluster.elect(2) == 2));
+  proposeAll(cluster, 2, 10, 310);
+  cluster.settle();
+
+  cluster.heartbeat(2);
+
+  //a new leader starts off assuming everyone has its log. 1's goes on past it, all in term 1,
+  //and one reply tells the leader to skip the whole term rather than walking back an entry at a time
+  cluster.isolate(1, false);
+  const uint64_t before = cluster.appendEntriesSent();
+  BOOST_TEST((cluster.elect(3) == 3));
+  BOOST_TEST(cluster.node(1).isFollower());
+  BOOST_TEST((cluster.node(1).driver().written() == 310));
+  //a heartbeat each, then 300 entries to 1 in 5 batches
+  BOOST_TEST((cluster.appendEntriesSent() - before == 2 + 5));
+  cluster.heartbeat(3);
+  BOOST_TEST(appliedAll(cluster, 310));
+}
+
+BOOST_AUTO_TEST_CASE(raft_compaction) {
+  ReplicationOptions replication;
+  replication.compactAfter = 16;
+  MemoryCluster cluster{ 3, replication };
+  cluster.elect(1);
+  proposeAll(cluster, 1, 0, 100);
+  cluster.settle();
+  cluster.heartbeat(1);
+  cluster.heartbeat(1);
+
+  //everyone compacts what they've committed, and still answers for the rest
+  for (NodeId id = 1; id <= 3; ++id) {
+    auto const& driver = cluster.node(id).driver();
+    BOOST_TEST((driver.written() == 100));
+    BOOST_TEST((driver.snapshotInfo().index > 100 - 16));
+    BOOST_TEST((driver.logEntries() < 16));
+  }
+  BOOST_TEST(appliedAll(cluster, 100));
+  BOOST_TEST((cluster.installSnapshotSent() == 0));
+}
+
+BOOST_AUTO_TEST_CASE(raft_install_snapshot) {
+  ReplicationOptions replication;
+  replication.compactAfter = 16;
+  replication.snapshotChunkBytes = 100;
+  MemoryCluster cluster{ 3, replication };
+  cluster.elect(1);
+  cluster.isolate(3);
+  proposeAll(cluster, 1, 0, 100);
+  cluster.settle();
+  cluster.heartbeat(1);
+  BOOST_TEST((cluster.node(1).driver().snapshotInfo().index > 0));
+
+  //what 3 missed is only in the snapshot now, so that's what it gets, in pieces
+  cluster.isolate(3, false);
+  const uint64_t before = cluster.installSnapshotSent();
+  cluster.heartbeat(1);
+  auto const& driver = cluster.node(3).driver();
+  BOOST_TEST((driver.snapshotInfo().index == cluster.node(1).driver().snapshotInfo().index));
+  BOOST_TEST((driver.written() == 100));
+  const uint64_t snapshotBytes = cluster.node(1).driver().snapshot()->size();
+  //the leader carries on from where it got to sending while 3 was away, is told 3 has nothing, and starts over
+  BOOST_TEST((cluster.installSnapshotSent() - before == 1 + (snapshotBytes + 99) / 100));
+
+  //and carries on as normal after
+  proposeAll(cluster, 1, 100, 110);
+  cluster.settle();
+  cluster.heartbeat(1);
+  BOOST_TEST(appliedAll(cluster, 110));
+}
+
+BOOST_AUTO_TEST_CASE(raft_install_snapshot_lost_chunks) {
+  ReplicationOptions replication;
+  replication.compactAfter = 16;
+  replication.snapshotChunkBytes = 64;
+  replication.maxInFlight = 4;
+  MemoryCluster cluster{ 3, replication };
+  cluster.elect(1);
+  cluster.isolate(3);
+  proposeAll(cluster, 1, 0, 100);
+  cluster.settle();
+  cluster.heartbeat(1);
+
+  //3 gets the first few chunks, then the rest in flight are lost
+  cluster.isolate(3, false);
+  cluster.fire(1);
+  cluster.deliver(cluster.pending());
+  cluster.deliver(cluster.pending());
+  cluster.isolate(3);
+  cluster.settle();
+  BOOST_TEST((cluster.node(3).driver().snapshotInfo().index == 0));
+
+  //the next heartbeat finds out where 3 is up to, and carries on from there
+  cluster.isolate(3, false);
+  cluster.heartbeat(1);
+  cluster.heartbeat(1);
+  BOOST_TEST((cluster.node(3).driver().snapshotInfo().index > 0));
+  BOOST_TEST(appliedAll(cluster, 100));
+}
+
+BOOST_AUTO_TEST_CASE(raft_group_commit) {
+  //10 proposals at a time, with a hop of the network in between
+  auto run = [](MemoryCluster& cluster) {
+    cluster.elect(1);
+    for (size_t i = 0; i < 100; i += 10) {
+      proposeAll(cluster, 1, i, i + 10);
+      cluster.deliver(cluster.pending());
+    }
+    cluster.settle();
+    cluster.heartbeat(1);
+    uint64_t flushes = 0;
+    for (NodeId id = 1; id <= cluster.size(); ++id) {
+      flushes += cluster.node(id).driver().flushes();
+    }
+    return flushes;
+  };
+
+  MemoryCluster eager{ 3 };
+  const uint64_t eagerFlushes = run(eager);
+  BOOST_TEST(appliedAll(eager, 100));
+
+  ReplicationOptions replication;
+  replication.groupCommit = true;
+  MemoryCluster grouped{ 3, replication };
+  const uint64_t groupedFlushes = run(grouped);
+  BOOST_TEST(appliedAll(grouped, 100));
+  //at least one per proposal on the leader alone, against one per node per hop
+  BOOST_TEST((eagerFlushes >= 100));
+  BOOST_TEST((groupedFlushes * 4 < eagerFlushes));
+}
+
+BOOST_AUTO_TEST_CASE(raft_group_commit_holds_replies) {
+  ReplicationOptions replication;
+  replication.groupCommit = true;
+  MemoryCluster cluster{ 3, replication };
+  cluster.elect(1);
+  BOOST_TEST((cluster.pending() == 0));
+
+  auto data = bytes(0);
+  Entry entry{ 1, data };
+  cluster.node(2).recv(1, AppendEntries{ 1, 0, 0, 0, dlib::Array_view<Entry>{ &entry, 1 }, 0 });
+  //written, but not acknowledged till it's durable
+  BOOST_TEST((cluster.node(2).driver().written() == 1));
+  BOOST_TEST((cluster.pending() == 0));
+  const uint64_t flushes = cluster.node(2).driver().flushes();
+  cluster.node(2).flush();
+  BOOST_TEST((cluster.node(2).driver().flushes() == flushes + 1));
+  BOOST_TEST((cluster.pending() == 1));
+
+  //nothing new, nothing to do
+  cluster.node(2).flush();
+  BOOST_TEST((cluster.node(2).driver().flushes() == flushes + 1));
+}
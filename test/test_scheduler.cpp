@@ -0,0 +1,160 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <dlib/scheduler.hpp>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <thread>
+#include <vector>
+
+namespace {
+  using Deque = dlib::scheduler_impl::Work_deque<int*>;
+
+  uint64_t fib(dlib::Scheduler& scheduler, uint64_t n) {
+    if (n < 2) {
+      return n;
+    }
+    uint64_t left = 0;
+    dlib::Scheduler::Task_group group;
+    scheduler.spawn(group, [&scheduler, &left, n]() { left = fib(scheduler, n - 1); });
+    const uint64_t right = fib(scheduler, n - 2);
+    scheduler.wait(group);
+    return left + right;
+  }
+
+  /*the same code against any concurrency policy*/
+  template<typename Concurrency>
+  int sum_squares(int n) {
+    std::vector<int> squares(n);
+    Concurrency::parallel_for(0, n, [&squares](int i) { squares[i] = i * i; });
+    std::atomic<int> total{ 0 };
+    dlib::Task_group<Concurrency> group;
+    for (int i = 0; i < n; ++i) {
+      Concurrency::spawn(group, [&total, &squares, i]() { total += squares[i]; });
+    }
+    Concurrency::wait(group);
+    return total.load();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(work_deque) {
+  Deque deque{ 2 };
+  int values[5] = { 0, 1, 2, 3, 4 };
+  BOOST_TEST((deque.pop() == nullptr));
+  BOOST_TEST((deque.steal() == nullptr));
+  for (int& value : values) {
+    deque.push(&value);
+  }
+  //grew past its starting 2
+  BOOST_TEST((deque.steal() == &values[0]));
+  BOOST_TEST((deque.pop() == &values[4]));
+  BOOST_TEST((deque.pop() == &values[3]));
+  BOOST_TEST((deque.steal() == &values[1]));
+  BOOST_TEST((deque.pop() == &values[2]));
+  BOOST_TEST(deque.empty());
+  BOOST_TEST((deque.pop() == nullptr));
+}
+
+BOOST_AUTO_TEST_CASE(work_deque_thieves) {
+  constexpr int count = 100000;
+  std::vector<int> values(count);
+  std::vector<std::atomic<int>> taken(count);
+  Deque deque;
+  std::atomic<bool> pushing{ true };
+
+  std::vector<std::thread> thieves;
+  for (int t = 0; t < 3; ++t) {
+    thieves.emplace_back([&]() {
+      while (pushing.load() || !deque.empty()) {
+        if (int* stolen = deque.steal()) {
+          ++taken[stolen - values.data()];
+        }
+      }
+    });
+  }
+  for (int i = 0; i < count; ++i) {
+    deque.push(&values[i]);
+    if (i % 3 == 0) {
+      if (int* popped = deque.pop()) {
+        ++taken[popped - values.data()];
+      }
+    }
+  }
+  while (int* popped = deque.pop()) {
+    ++taken[popped - values.data()];
+  }
+  pushing = false;
+  for (auto& thief : thieves) {
+    thief.join();
+  }
+
+  bool once_each = true;
+  for (auto const& times : taken) {
+    once_each = once_each && times.load() == 1;
+  }
+  BOOST_TEST(once_each);
+}
+
+BOOST_AUTO_TEST_CASE(scheduler_spawn_wait) {
+  dlib::Scheduler scheduler{ 4 };
+  std::atomic<int> ran{ 0 };
+  dlib::Scheduler::Task_group group;
+  for (int i = 0; i < 1000; ++i) {
+    scheduler.spawn(group, [&ran]() { ++ran; });
+  }
+  scheduler.wait(group);
+  BOOST_TEST((ran.load() == 1000));
+  BOOST_TEST(group.done());
+}
+
+BOOST_AUTO_TEST_CASE(scheduler_wait_sleeps) {
+  dlib::Scheduler scheduler{ 1 };
+  dlib::Scheduler::Task_group group;
+  //stands in for a task blocked on I/O
+  scheduler.spawn(group, []() { std::this_thread::sleep_for(std::chrono::milliseconds(300)); });
+
+  const std::clock_t started = std::clock();
+  scheduler.wait(group);
+  const double spent = static_cast<double>(std::clock() - started) / CLOCKS_PER_SEC;
+  BOOST_TEST(group.done());
+  //nothing to steal, so the wait sleeps rather than burning the whole 300ms
+  BOOST_TEST((spent < 0.1));
+}
+
+BOOST_AUTO_TEST_CASE(scheduler_nested_wait) {
+  //waiting inside tasks only works if waiters run other tasks meanwhile
+  dlib::Scheduler scheduler{ 2 };
+  BOOST_TEST((fib(scheduler, 20) == 6765));
+}
+
+BOOST_AUTO_TEST_CASE(scheduler_parallel_for) {
+  dlib::Scheduler scheduler{ 4 };
+  std::vector<std::atomic<int>> hit(10000);
+  scheduler.parallel_for(size_t{ 0 }, hit.size(), [&hit](size_t i) { ++hit[i]; });
+  bool once_each = true;
+  for (auto const& times : hit) {
+    once_each = once_each && times.load() == 1;
+  }
+  BOOST_TEST(once_each);
+  //empty ranges do nothing
+  scheduler.parallel_for(5, 5, [](int) { BOOST_TEST(false); });
+}
+
+BOOST_AUTO_TEST_CASE(scheduler_destructor_drains) {
+  std::atomic<int> ran{ 0 };
+  {
+    dlib::Scheduler scheduler{ 2 };
+    for (int i = 0; i < 100; ++i) {
+      scheduler.spawn([&ran]() { ++ran; });
+    }
+  }
+  BOOST_TEST((ran.load() == 100));
+}
+
+BOOST_AUTO_TEST_CASE(concurrency_policies) {
+  constexpr int expected = 328350;
+  BOOST_TEST((sum_squares<dlib::Null_concurrency>(100) == expected));
+  BOOST_TEST((sum_squares<dlib::Std_concurrency>(100) == expected));
+  BOOST_TEST((sum_squares<dlib::Work_stealing_concurrency>(100) == expected));
+}
@@ -0,0 +1,110 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <dlib/slab.hpp>
+#include <string>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <vector>
+#include <memory_resource>
+
+namespace {
+  struct Counted {
+    Counted(int value_, int* alive_) noexcept :
+      value{ value_ },
+      alive{ alive_ } {
+      ++*alive;
+    }
+    ~Counted() noexcept {
+      --*alive;
+    }
+    int value;
+    int* alive;
+  };
+
+  struct Throws {
+    Throws() {
+      throw std::runtime_error{ "can't" };
+    }
+  };
+}
+
+BOOST_AUTO_TEST_CASE(slab_reuses_storage) {
+  dlib::Slab<std::string, dlib::Chunk_size_is<1024>> slab;
+  std::string* first = slab.allocate();
+  std::string* second = slab.allocate();
+  BOOST_TEST((first != nullptr && second != nullptr && first != second));
+  slab.deallocate(first);
+  BOOST_TEST((slab.allocate() == first));
+  BOOST_TEST((slab.reserved() >= 1024 - sizeof(std::string)));
+}
+
+BOOST_AUTO_TEST_CASE(slab_make) {
+  dlib::Slab<Counted> slab;
+  int alive = 0;
+  Counted* address = nullptr;
+  {
+    auto made = slab.make(5, &alive);
+    BOOST_TEST(!!made);
+    BOOST_TEST((made.value()->value == 5));
+    BOOST_TEST((alive == 1));
+    address = made.value().get();
+  }
+  //destroyed and given back when the pointer went
+  BOOST_TEST((alive == 0));
+  auto again = slab.make(6, &alive);
+  BOOST_TEST((again.value().get() == address));
+}
+
+BOOST_AUTO_TEST_CASE(slab_make_throws) {
+  dlib::Slab<Throws> slab;
+  Throws* storage = slab.allocate();
+  slab.deallocate(storage);
+  //make throws before there is anything to keep
+  BOOST_CHECK_THROW((void)slab.make(), std::runtime_error);
+  //the storage went back when the constructor threw
+  BOOST_TEST((slab.allocate() == storage));
+}
+
+BOOST_AUTO_TEST_CASE(arena_size_classes) {
+  dlib::Arena<dlib::Chunk_size_is<4096>> arena;
+  void* small = arena.allocate(10);
+  void* aligned = arena.allocate(24, 64);
+  BOOST_TEST((reinterpret_cast<uintptr_t>(aligned) % 64 == 0));
+  BOOST_TEST((arena.in_use() == 16 + 64));
+  arena.deallocate(small, 10);
+  BOOST_TEST((arena.allocate(16) == small));
+
+  //too big to carve, goes to operator new
+  void* big = arena.allocate(4096);
+  BOOST_TEST((big != nullptr));
+  arena.deallocate(big, 4096);
+  BOOST_TEST((arena.reserved() == 4096));
+
+  //more than any size class could double up to, still goes to operator new and fails there
+  const size_t huge = std::numeric_limits<size_t>::max() / 2 + 2;
+  BOOST_TEST((arena.allocate(huge) == nullptr));
+  dlib::Arena_resource<dlib::Arena<dlib::Chunk_size_is<4096>>> resource{ arena };
+  BOOST_CHECK_THROW(resource.allocate(huge), std::bad_alloc);
+}
+
+BOOST_AUTO_TEST_CASE(arena_containers) {
+  using Arena = dlib::Arena<>;
+  Arena arena;
+  dlib::Arena_resource<Arena> resource{ arena };
+  {
+    std::pmr::vector<int> numbers{ &resource };
+    for (int i = 0; i < 1000; ++i) {
+      numbers.push_back(i);
+    }
+    BOOST_TEST((numbers[999] == 999));
+    BOOST_TEST((arena.in_use() > 0));
+  }
+  BOOST_TEST((arena.in_use() == 0));
+
+  std::vector<double, dlib::Arena_allocator<double, Arena>> doubles{ dlib::Arena_allocator<double, Arena>{ arena } };
+  doubles.resize(100, 1.5);
+  BOOST_TEST((doubles[50] == 1.5));
+  BOOST_TEST((arena.in_use() == 1024));
+}